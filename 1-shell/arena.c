@@ -12,6 +12,7 @@ struct arena {
 };
 
 static struct arena *cur_arena = NULL;
+static size_t n_arenas = 0, peak_arenas = 0;
 int dealloc_on_pop_all = 1;
 
 void arena_push(void)
@@ -23,6 +24,8 @@ void arena_push(void)
 	a->next = cur_arena;
 	a->m = m;
 	cur_arena = a;
+	if (++n_arenas > peak_arenas)
+		peak_arenas = n_arenas;
 }
 
 void arena_pop_all(void)
@@ -37,6 +40,7 @@ void arena_pop_all(void)
 			mc_unregister_all_mem(cur_arena->m);
 			free(cur_arena);
 			cur_arena = next;
+			n_arenas--;
 		}
 	}
 }
@@ -59,6 +63,7 @@ void arena_pop(void)
 	mc *m = cur_arena->m;
 
 	cur_arena = cur_arena->next;
+	n_arenas--;
 	// The old arena is saved in this `mc`
 	mc_free_all_mem(m);
 }
@@ -80,3 +85,22 @@ void *arena_malloc(size_t nmemb, size_t member_size)
 	assert(cur_arena);
 	return mc_malloc(cur_arena->m, nmemb, member_size);
 }
+
+size_t arena_peak_amount(void)
+{
+	return peak_arenas;
+}
+
+size_t arena_stats(struct arena_stat *stats, size_t max)
+{
+	size_t n = 0;
+
+	for (struct arena *cur = cur_arena; cur && n < max; cur = cur->next) {
+		// Counted like mc_stats, so with the arena's own bookkeeping
+		stats[n].bytes = mc_bytes(cur->m);
+		stats[n].allocs = mc_allocs(cur->m);
+		n++;
+	}
+
+	return n;
+}
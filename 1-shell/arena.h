@@ -20,6 +20,20 @@ void arena_pop_all(void);
 // Get the amount of arena's.
 size_t arena_amount(void);
 
+// Get the highest amount of arena's there has been at once.
+size_t arena_peak_amount(void);
+
+// Counted as in `mc_stats`, including the arena's own bookkeeping, so that the
+// arena's add up to the mc totals.
+struct arena_stat {
+	size_t bytes;  // Allocated in the arena and not yet freed.
+	size_t allocs; // Allocations made in the arena.
+};
+
+// Fill `stats` with the usage of at most `max` arena's, starting at the
+// current one, and return how many were filled in.
+size_t arena_stats(struct arena_stat *stats, size_t max);
+
 // Register the memory given in `pt` in the current arena. It will be freed with
 // the function given by `fun` when the arena is popped.
 void arena_register_mem(void *pt, const free_fun fun);
@@ -1,6 +1,8 @@
 #!/usr/bin/env python3
 from __future__ import print_function
 
+import argparse
+import json
 import os
 import re
 import shlex
@@ -8,6 +10,7 @@ import shutil
 import signal
 import subprocess
 import sys
+import tempfile
 import time
 import pexpect
 
@@ -185,17 +188,43 @@ def run(writer=None):
                        bash_cmp("ls | { grep c ; ls /bin ; } | tac")),
                   Test("Seq wait 1",
                        test_wait("{ sleep 1 | sleep 2; }; exit 1", 2)),
+                  Test("Failing part",
+                       manual_cmp("false | cat", out="",
+                                  err="false: command failed with exit "
+                                  "status 1\n")),
+                  ),
+        TestGroup("Redirections", 1.0,
+                  Test("To/from file", bash_cmp(">a ls /bin; <a wc -l")),
+                  Test("Overwrite", bash_cmp(">a ls /bin; >a ls; cat a")),
                   ),
-        # TestGroup("Redirections", 1.0,
-        #           Test("To/from file", bash_cmp(">a ls /bin; <a wc -l")),
-        #           Test("Overwrite", bash_cmp(">a ls /bin; >a ls; cat a")),
-        #           ),
         TestGroup("Detached commands", 0.5,
                   Test("sleep", test_detach),
                   ),
         TestGroup("Subshells", 0.5,
                   Test("exit", bash_cmp("(pwd; exit 2); exit 1")),
                   Test("cd", bash_cmp("cd /bin; pwd; (cd /; pwd); pwd")),
+                  Test("exit restores cwd",
+                       bash_cmp("(cd /tmp; pwd; exit 3; pwd); pwd")),
+                  Test("Nested",
+                       bash_cmp("cd /usr; ((cd /; exit 1); pwd; cd /tmp; pwd); "
+                                "pwd")),
+                  Test("Pipe in body",
+                       bash_cmp("(cd /; ls -d usr | cat; exit); pwd")),
+                  Test("Commands after exit",
+                       bash_cmp("(exit 4); echo after")),
+                  ),
+        TestGroup("Deep nesting", 0.5,
+                  Test("Subshells",
+                       manual_cmp("(" * 1000 + "echo deep" + ")" * 1000,
+                                  out="deep\n", err="", rv=0)),
+                  Test("Groups",
+                       bash_cmp("{ " * 1000 + "pwd" + "; }" * 1000)),
+                  Test("Long pipe", bash_cmp("echo a" + " | cat" * 300)),
+                  Test("Recovery",
+                       script_cmp("(" * 1000 + "echo x" + ")" * 999 + "\n" +
+                                  "{ " * 1000 + "echo deep" + "; }" * 1000 +
+                                  "\n", ["-p"], out="deep\n",
+                                  err="mysh: syntax error\n")),
                   ),
         TestGroup("Environment variables", 0.5,
                   Test("Simple", manual_cmp("set hello=world; env | grep hello",
@@ -211,6 +240,29 @@ def run(writer=None):
                   Test("Ctrl-z", test_ctrl_z),
                   Test("Ctrl-z + bg + fg", test_bg_fg),
                   ),
+        TestGroup("memo built-in", 0.5,
+                  Test("Replay", test_memo_replay),
+                  Test("Dependencies", test_memo_deps),
+                  Test("Usage", manual_cmp("memo", out="",
+                                           err="usage: memo [-f FILE]... "
+                                           "COMMAND [ARG]...\n")),
+                  ),
+        TestGroup("Compiled scripts", 0.5,
+                  Test("Compile and run", test_image_run),
+                  Test("Stale image", test_image_stale),
+                  Test("Invalid image", test_image_invalid),
+                  ),
+        TestGroup("Parse-ahead (-p)", 0.5,
+                  Test("In order",
+                       script_cmp("cd /\npwd\n(cd /usr; pwd)\npwd\n"
+                                  "exit 3\necho not reached\n", ["-p"],
+                                  out="/\n/usr\n/\n", err="", rv=3)),
+                  Test("Lexer errors in order",
+                       script_cmp("echo a\necho \"b\necho c\n", ["-p"],
+                                  out="a\nmysh: unterminated quoted string\n"
+                                  "mysh: syntax error\nc\n",
+                                  merge_stderr=True)),
+                  ),
     ]
 
     points = test_groups(basic_tests, writer)
@@ -230,7 +282,7 @@ def run(writer=None):
                                                                  totalpoints))
 
 
-def run_cmd(cmd, shell=None, prefix=None):
+def run_cmd(cmd, shell=None, prefix=None, env=None):
     global last_command
     last_command = cmd
     shell = shell or STUDENT_SHELL
@@ -238,7 +290,7 @@ def run_cmd(cmd, shell=None, prefix=None):
     return subprocess.Popen(
         prefix + [shell, "-c", cmd],
         stdout=subprocess.PIPE, stderr=subprocess.PIPE,
-        stdin=subprocess.PIPE, universal_newlines=True)
+        stdin=subprocess.PIPE, universal_newlines=True, env=env)
 
 
 def run_mysh(cmd):
@@ -342,6 +394,137 @@ def manual_cmp(cmd, out=None, err=None, rv=None):
     return manual_cmp_inner
 
 
+def run_script(script, args=None, merge_stderr=False):
+    global last_command
+    last_command = script
+    with open("_script.sh", "w") as f:
+        f.write(script)
+    p = subprocess.Popen(
+        [STUDENT_SHELL] + (args or []) + ["_script.sh"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT if merge_stderr else subprocess.PIPE,
+        stdin=subprocess.DEVNULL, universal_newlines=True)
+    out, err = p.communicate()
+    return p.returncode, out, err
+
+
+# Like manual_cmp, but for a script file run with `args`. With merge_stderr
+# `out` is checked against stdout and stderr interleaved.
+def script_cmp(script, args=None, out=None, err=None, rv=None,
+               merge_stderr=False):
+    def script_cmp_inner():
+        rv1, stdout1, stderr1 = run_script(script, args, merge_stderr)
+
+        try:
+            if out is not None:
+                eq(stdout1, out, "stdout")
+            if err is not None:
+                eq(stderr1, err, "stderr")
+            if rv is not None:
+                eq(rv1, rv, "return value")
+        except TestError as e:
+            raise TestError("Error while comparing your shell output to " +
+                            "expected output.\nScript:\n%s\n%s" %
+                            (script, e.args[0]))
+
+    return script_cmp_inner
+
+
+def compile_script(script):
+    with open("_script.sh", "w") as f:
+        f.write(script)
+    with open("_script.img", "wb") as f:
+        p = subprocess.Popen([STUDENT_SHELL, "--compile", "_script.sh"],
+                             stdout=f, stderr=subprocess.PIPE,
+                             stdin=subprocess.DEVNULL)
+        _, err = p.communicate()
+    if p.returncode:
+        raise TestError("Compiling the script failed.\nScript:\n%s\n"
+                        "Return code: %d\nstderr: %s" %
+                        (script, p.returncode, err.decode("UTF-8")))
+
+
+def run_image():
+    global last_command
+    last_command = "%s _script.img" % STUDENT_SHELL
+    p = subprocess.Popen([STUDENT_SHELL, "_script.img"],
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                         stdin=subprocess.DEVNULL, universal_newlines=True)
+    out, err = p.communicate()
+    return p.returncode, out, err
+
+
+def image_cmp(out, err, rv):
+    rv1, stdout1, stderr1 = run_image()
+    try:
+        eq(stdout1, out, "stdout")
+        eq(stderr1, err, "stderr")
+        eq(rv1, rv, "return value")
+    except TestError as e:
+        raise TestError("Error while running the compiled script.\n%s" %
+                        e.args[0])
+
+
+def test_image_run():
+    compile_script("(cd /usr; pwd) | tr a-z A-Z\n>_out echo image; cat _out\n"
+                   "cd /\npwd\nexit 4\necho not reached\n")
+    image_cmp("/USR\nimage\n/\n", "", 4)
+
+
+def test_image_stale():
+    compile_script("echo one\n")
+    with open("_script.sh", "w") as f:
+        f.write("echo two\n")
+    image_cmp("", "_script.img: compiled script is out of date\n", 1)
+
+
+def test_image_invalid():
+    compile_script("echo one\n")
+    with open("_script.img", "r+b") as f:
+        f.truncate(os.path.getsize("_script.img") // 2)
+    image_cmp("", "_script.img: invalid compiled script\n", 1)
+
+
+# Run `cmd` once per entry of `expected` (pairs of stdout and stderr), each
+# time in a new shell sharing one memo cache. `before` is called before each
+# run with its index.
+def memo_runs(cmd, expected, before=None):
+    with tempfile.TemporaryDirectory(prefix="42sh-memo-") as cache:
+        env = dict(os.environ, XDG_CACHE_HOME=cache)
+        for i, (out, err) in enumerate(expected):
+            if before:
+                before(i)
+            p = run_cmd(cmd, env=env)
+            stdout, stderr = p.communicate()
+            try:
+                eq(stdout, out, "stdout")
+                eq(stderr, err, "stderr")
+            except TestError as e:
+                raise TestError("Error in run %d of a memoized command.\n"
+                                "Command: %s\n%s" % (i + 1, cmd, e.args[0]))
+
+
+def test_memo_replay():
+    if os.path.exists("_memo_runs"):
+        os.remove("_memo_runs")
+    memo_runs('memo sh -c "echo x >> _memo_runs; echo out; echo err >&2; '
+              'exit 3"',
+              [("out\n", "err\nsh: command failed with exit status 3\n")] * 2)
+    with open("_memo_runs") as f:
+        eq(f.read(), "x\n", "runs of the memoized command")
+
+
+def test_memo_deps():
+    # The second run replays the first; the third follows the new contents.
+    def write_dep(i):
+        if i != 1:
+            with open("_memo_dep", "w") as f:
+                f.write("one\n" if i == 0 else "three\n")
+
+    memo_runs("memo -f _memo_dep cat _memo_dep",
+              [("one\n", ""), ("one\n", ""), ("three\n", "")], write_dep)
+
+
 def test_wait(cmd, timeout, out='', err='', offset=0.3):
     timeout = float(timeout)
 
@@ -658,6 +841,189 @@ def fix_makefiles():
     except IOError:
         pass
 
+# Performance regression suite (--bench). Every workload yields one metric;
+# "higher" metrics are rates, "lower" metrics are times. Each workload is run
+# several times and the best result is kept, which filters out most noise.
+BENCH_BASELINE = "bench-baseline.json"
+BENCH_TOLERANCE = 0.25
+BENCH_REPEAT = 5
+
+
+class BenchMetric():
+    def __init__(self, name, unit, better, func):
+        self.name, self.unit, self.better, self.func = name, unit, better, func
+
+
+def timed(args, stdin=None):
+    global last_command
+    last_command = ' '.join(args)
+    start_time = time.perf_counter()
+    p = subprocess.Popen(args, stdout=subprocess.DEVNULL,
+                         stderr=subprocess.PIPE, stdin=stdin)
+    _, err = p.communicate()
+    end_time = time.perf_counter()
+    if p.returncode:
+        raise TestError("Command returned non-zero value.\n" +
+                        "Command: %s\nReturn code: %d\nstderr: %s" %
+                        (last_command, p.returncode, err.decode("UTF-8")))
+    return end_time - start_time
+
+
+def bench_spawn(tmpdir, n=2000):
+    script = os.path.join(tmpdir, "spawn.sh")
+    with open(script, "w") as f:
+        f.write("/bin/true\n" * n)
+
+    def spawn():
+        with open(os.devnull) as devnull:
+            return n / timed([STUDENT_SHELL, script], stdin=devnull)
+
+    return spawn
+
+
+def bench_pipeline(tmpdir, stages=8, size=64 << 20):
+    data = os.path.join(tmpdir, "pipe.dat")
+    with open(data, "wb") as f:
+        f.write(b"0123456789abcdef" * (size // 16))
+    cmd = "cat %s" % data + " | cat" * (stages - 1)
+
+    def pipeline():
+        return size / (1 << 20) / timed([STUDENT_SHELL, "-c", cmd])
+
+    return pipeline
+
+
+def bench_parse(tmpdir, n=20000):
+    script = os.path.join(tmpdir, "parse.sh")
+    with open(script, "w") as f:
+        for i in range(n):
+            f.write("ls -l /tmp%d | grep -v x | wc -l; cd /; { pwd; echo %d; }"
+                    " | tac\n" % (i, i))
+
+    def parse():
+        with open(os.devnull) as devnull:
+            return n / timed([STUDENT_SHELL, "-n", script], stdin=devnull)
+
+    return parse
+
+
+def bench_startup(n=50):
+    def startup():
+        return min(timed([STUDENT_SHELL, "-c", "true"])
+                   for _ in range(n)) * 1000
+
+    return startup
+
+
+def bench_metrics(tmpdir):
+    return [
+        BenchMetric("spawn_rate", "commands/s", "higher", bench_spawn(tmpdir)),
+        BenchMetric("pipeline_throughput", "MiB/s", "higher",
+                    bench_pipeline(tmpdir)),
+        BenchMetric("parse_throughput", "lines/s", "higher",
+                    bench_parse(tmpdir)),
+        BenchMetric("startup_latency", "ms", "lower", bench_startup()),
+    ]
+
+
+def bench_compare(results, baseline, tolerances, default_tolerance):
+    regressions = []
+    for name, r in sorted(results.items()):
+        b = baseline.get(name)
+        if b is None:
+            print("\t%s: %.2f %s (no baseline)" % (name, r["value"], r["unit"]))
+            continue
+        tolerance = tolerances.get(name, default_tolerance)
+        change = (r["value"] - b["value"]) / b["value"]
+        worse = -change if r["better"] == "higher" else change
+        if worse > tolerance:
+            status = colored("REGRESSION", color='red')
+            regressions.append(name)
+        else:
+            status = colored("OK", color='green')
+        print("\t%s: %.2f %s (baseline %.2f, %+.1f%%, tolerance %.0f%%): %s" %
+              (name, r["value"], r["unit"], b["value"], change * 100,
+               tolerance * 100, status))
+    return regressions
+
+
+def bench(argv):
+    parser = argparse.ArgumentParser(
+        prog="check.py --bench",
+        description="Run the performance regression suite against ./42sh.")
+    parser.add_argument("--output", metavar="FILE",
+                        help="write the results as JSON to FILE")
+    parser.add_argument("--baseline", metavar="FILE", default=BENCH_BASELINE,
+                        help="baseline to compare against (default %s)" %
+                        BENCH_BASELINE)
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="store the results as the new baseline")
+    parser.add_argument("--tolerance", metavar="[METRIC=]FRACTION",
+                        action="append", default=[],
+                        help="allowed relative slowdown, for all metrics or "
+                        "one (default %.2f)" % BENCH_TOLERANCE)
+    parser.add_argument("--repeat", type=int, default=BENCH_REPEAT,
+                        help="runs per workload (default %d)" % BENCH_REPEAT)
+    parser.add_argument("--no-build", action="store_true",
+                        help="use the existing ./42sh instead of running make")
+    args = parser.parse_args(argv)
+
+    tolerances, default_tolerance = {}, BENCH_TOLERANCE
+    for t in args.tolerance:
+        name, _, value = t.rpartition("=")
+        if name:
+            tolerances[name] = float(value)
+        else:
+            default_tolerance = float(value)
+
+    if not args.no_build:
+        check_cmd(f"make ADDITIONAL_SOURCES='{additional_sources}'".encode("UTF-8"))
+
+    results = {}
+    with tempfile.TemporaryDirectory(prefix="42sh-bench-") as tmpdir:
+        for m in bench_metrics(tmpdir):
+            try:
+                values = [m.func() for _ in range(args.repeat)]
+            except TestError as e:
+                print("Benchmark %s failed:\n%s" % (m.name, e.args[0]))
+                return 1
+            best = max(values) if m.better == "higher" else min(values)
+            results[m.name] = {"value": best, "unit": m.unit,
+                               "better": m.better}
+
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            stored = json.load(f)
+        baseline = stored.get("metrics", {})
+        for name, t in stored.get("tolerances", {}).items():
+            tolerances.setdefault(name, t)
+
+    print(colored("Benchmarks", color='blue', bold=True))
+    regressions = bench_compare(results, baseline, tolerances,
+                                default_tolerance)
+
+    report = {"metrics": results, "regressions": regressions}
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+            f.write("\n")
+    if args.update_baseline:
+        stored = {"metrics": results, "tolerances": {}}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                stored["tolerances"] = json.load(f).get("tolerances", {})
+        with open(args.baseline, "w") as f:
+            json.dump(stored, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("Stored new baseline in %s" % args.baseline)
+        return 0
+
+    if regressions:
+        print("Performance regressions: %s" % ", ".join(regressions))
+        return 1
+    return 0
+
 
 def handle_sigterm(signum, frame):
     raise Exception("SIGTERM while executing command:\n\"%s\"" % last_command)
@@ -668,6 +1034,8 @@ if __name__ == '__main__':
     signal.signal(signal.SIGTERM, handle_sigterm)
     try:
         fix_makefiles()
+        if len(sys.argv) > 1 and sys.argv[1] == "--bench":
+            sys.exit(bench(sys.argv[2:]))
         run(open(sys.argv[1], 'w') if len(sys.argv) > 1 else None)
     except Exception as e:
         print("\n\nTester got exception: %s" % str(e))
\ No newline at end of file
@@ -3,27 +3,96 @@
 #include "parser/lexer.h"
 #include "parser/lex.yy.h"
 #include "shell.h"
+#include "front.h"
 #include "arena.h"
+#include "pipeline.h"
+#include "image.h"
+#include "optimize.h"
+#include "history_index.h"
+#include "path_index.h"
+#include "memstat.h"
+#include "parser/ast.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
 char *prompt = NULL;
 extern int echo, parse_error; /* From the parser */
 
+/* When set, parsed commands are stored in `parsed` instead of being run. */
+static int collect = 0;
+static node_t *parsed = NULL;
+static const char *lex_message = NULL;
+
+/* When set (-n), commands are parsed but not run. */
+static int noexec = 0;
+
+/* Set by -O and -M: report on exit. */
+static int report_optimizer = 0, report_memory = 0;
+
+/*
+ * The parser, kept from one command to the next along with any stack it has
+ * grown. The end of every command leaves it ready for the next one. Only one
+ * thread parses at a time, as for `collect` and `parsed`.
+ */
+static void *parser = NULL;
+
+static void run_parsed(node_t *n, int error, const char *message)
+{
+	if (message)
+		fprintf(stderr, "mysh: %s\n", message);
+	if (error) {
+		fprintf(stderr, "mysh: syntax error\n");
+		return;
+	}
+	if (echo)
+		print_tree_flat(n, 1);
+	memstat_command(n);
+	n = optimize_tree(n);
+	if (!noexec) {
+		path_index_expire();
+		run_command(n);
+	}
+	free_tree(n);
+}
+
+void dispatch_command(node_t *n)
+{
+	if (collect)
+		parsed = n;
+	else
+		run_parsed(n, 0, NULL);
+}
+
+void syntax_error(void)
+{
+	if (!collect)
+		fprintf(stderr, "mysh: syntax error\n");
+	parse_error = 1;
+}
+
+void lex_error(const char *message)
+{
+	if (collect)
+		lex_message = message;
+	else
+		fprintf(stderr, "mysh: %s\n", message);
+}
+
 static void handle_command(char *cmd)
 {
-	void *parser;
 	int yv;
 	struct lex_token tok;
 	YY_BUFFER_STATE st;
 
 	/* Prepare a parser context */
-	parser = ParseAlloc(malloc);
+	if (parser == NULL)
+		parser = ParseAlloc(malloc);
 	parse_error = 0;
 
 	/* Prepare a lexer context */
@@ -52,10 +121,87 @@ static void handle_command(char *cmd)
 	/* Complete parse */
 	Parse(parser, 0, tok);
 
-	ParseFree(parser, free);
 	yy_delete_buffer(st);
 }
 
+/* Parse `cmd` without running it; used by the parse-ahead thread. */
+static int parse_command(char *cmd, node_t **out, const char **message)
+{
+	collect = 1;
+	parsed = NULL;
+	lex_message = NULL;
+	handle_command(cmd);
+	*out = parsed;
+	*message = lex_message;
+	return parse_error;
+}
+
+/*
+ * Prepare to run commands. Only done once it is clear that commands will be
+ * run, so that -h and --compile leave no exit handlers behind.
+ */
+static void start(void)
+{
+	atexit(&arena_pop_all);
+	atexit(&shell_exit);
+	/* Registered after arena_pop_all so they run first, while the arenas
+	 * they report on still exist. */
+	if (report_optimizer)
+		optimize_report_at_exit();
+	if (report_memory)
+		memstat_report_at_exit();
+	initialize();
+}
+
+/* Run every command of the compiled script at `path`, if it is one. */
+static int run_image(const char *path)
+{
+	struct image img;
+
+	switch (image_open(path, &img)) {
+	case IMAGE_NOT_IMAGE:
+		return 0;
+	case IMAGE_STALE:
+		fprintf(stderr, "%s: compiled script is out of date\n", path);
+		exit(1);
+	case IMAGE_ERROR:
+		fprintf(stderr, "%s: invalid compiled script\n", path);
+		exit(1);
+	case IMAGE_OK:
+		break;
+	}
+
+	start();
+	for (size_t i = 0; i < img.n_commands; i++) {
+		if (echo)
+			print_tree_flat(img.commands[i], 1);
+		if (!noexec) {
+			path_index_expire();
+			run_command(img.commands[i]);
+		}
+	}
+	image_close(&img);
+	return 1;
+}
+
+/* Set by --startup-profile: time of the end of the previous phase. */
+static int profile = 0;
+static struct timespec profile_last;
+
+/* Print how long the startup phase that just ended took. */
+static void profile_phase(const char *phase)
+{
+	struct timespec now;
+
+	if (!profile)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(stderr, "startup: %-14s %8.3f ms\n", phase,
+		(now.tv_sec - profile_last.tv_sec) * 1e3 +
+			(now.tv_nsec - profile_last.tv_nsec) / 1e6);
+	profile_last = now;
+}
+
 void my_yylex_destroy(void)
 {
 	yylex_destroy();
@@ -63,23 +209,37 @@ void my_yylex_destroy(void)
 
 int main(int argc, char *argv[])
 {
-	int save_history = 0;
-	char *line;
+	static const struct option long_opts[] = {
+		{ "compile", required_argument, NULL, 'C' },
+		{ "startup-profile", no_argument, NULL, 'S' },
+		{ 0, 0, 0, 0 }
+	};
+	int save_history = 0, parse_ahead = 0;
+	char *line, *command = NULL;
 	int opt;
 
-	atexit(&arena_pop_all);
-    atexit(&shell_exit);
+	clock_gettime(CLOCK_MONOTONIC, &profile_last);
 
 	/* Command-line argument parsing */
-	while ((opt = getopt(argc, argv, "hec:")) != -1) {
+	/* Options after -c CMD are ignored. */
+	while (!command &&
+	       (opt = getopt_long(argc, argv, "hepnOMc:", long_opts, NULL)) != -1) {
 		switch (opt) {
 		case 'h':
 			printf("usage: %s [OPTS] [FILE]\n"
 			       "options:\n"
 			       " -h      print this help.\n"
 			       " -e      echo commands before running them.\n"
+			       " -p      parse FILE ahead of running it.\n"
+			       " -n      parse commands without running them.\n"
+			       " -O      report AST optimizer savings on exit.\n"
+			       " -M      report memory usage on exit.\n"
 			       " -c CMD  run this command then exit.\n"
-			       " FILE    read commands from FILE.\n",
+			       " --compile FILE\n"
+			       "         write a compiled image of FILE to stdout.\n"
+			       " --startup-profile\n"
+			       "         print the time taken by each startup phase.\n"
+			       " FILE    read commands from FILE (script or image).\n",
 			       argv[0]);
 			return EXIT_SUCCESS;
 
@@ -87,22 +247,61 @@ int main(int argc, char *argv[])
 			echo = 1;
 			break;
 
+		case 'p':
+			parse_ahead = 1;
+			break;
+
+		case 'n':
+			noexec = 1;
+			break;
+
+		case 'O':
+			report_optimizer = 1;
+			break;
+
+		case 'M':
+			report_memory = 1;
+			break;
+
 		case 'c':
-			initialize();
-			handle_command(optarg);
-			return 0;
+			command = optarg;
+			break;
+
+		case 'S':
+			profile = 1;
+			break;
+
+		case 'C':
+			return image_compile(optarg, stdout, &parse_command) ?
+				       EXIT_FAILURE : EXIT_SUCCESS;
 		}
 	}
 
+	profile_phase("options");
+
+	/* Nothing but the command itself is needed for -c. */
+	if (command) {
+		start();
+		profile_phase("initialize");
+		handle_command(command);
+		profile_phase("command");
+		return 0;
+	}
+
 	/* Reading commands from either a script or stdin */
 	if (optind >= argc) {
 		/* Reading from stdin; handle history if terminal. */
 		if (isatty(0)) {
 			using_history();
 			read_history(0);
+			history_index_bind();
+			path_index_bind();
 			prompt = "42sh$ ";
 			save_history = 1;
+			profile_phase("history");
 		}
+	} else if (run_image(argv[optind])) {
+		return 0;
 	} else {
 		/* Reading from file. */
 		FILE *f = fopen(argv[optind], "r");
@@ -110,19 +309,34 @@ int main(int argc, char *argv[])
 			perror(argv[optind]);
 			exit(1);
 		}
+		profile_phase("open script");
+		if (parse_ahead) {
+			start();
+			pipeline_run(f, &parse_command, &run_parsed);
+			fclose(f);
+			return 0;
+		}
 		rl_instream = f;
 		prompt = NULL;
 	}
 
 	/* The main loop. */
-	initialize();
+	start();
+	profile_phase("initialize");
+	if (save_history)
+		profile = 0; /* The rest waits for the user. */
 	while ((line = readline(prompt))) {
 		if (save_history && line[0] != '\0') {
 			add_history(line);
+			history_index_add(line);
 			write_history(NULL);
 		}
 		handle_command(line);
 		free(line);
+		if (profile) {
+			profile_phase("first command");
+			profile = 0;
+		}
 	}
 
 	return 0;
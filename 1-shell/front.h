@@ -1,3 +1,22 @@
 #ifndef FRONT_H
 #define FRONT_H
+
+struct tree_node;
+
+/*
+ * Called by the parser for every complete, error-free command. Either runs
+ * the command right away or hands it to whoever requested the parse.
+ */
+void dispatch_command(struct tree_node *n);
+
+/*
+ * Called by the parser when the input contains a syntax error.
+ */
+void syntax_error(void);
+
+/*
+ * Called by the lexer when it rejects the input, with a message for the user.
+ */
+void lex_error(const char *message);
+
 #endif
@@ -0,0 +1,20 @@
+#ifndef HASH_H
+#define HASH_H
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a hash of `len` bytes at `data`. Fast and well spread for the
+// short keys and file contents the shell hashes; not meant to resist
+// deliberate collisions.
+static inline uint64_t hash_fnv1a(const char *data, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+#endif /* HASH_H */
@@ -0,0 +1,362 @@
+#include "history_index.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <readline/readline.h>
+#include <readline/history.h>
+
+// Entries containing one trigram, in increasing order.
+struct postings {
+	uint32_t key; // Three bytes of the trigram; 0 marks an empty slot.
+	uint32_t n_ids, cap;
+	uint32_t *ids;
+};
+
+static char **entries = NULL;
+static unsigned char *hidden = NULL; // Set when a newer duplicate exists.
+static size_t n_entries = 0, entries_cap = 0;
+
+// Open addressing table from trigram to postings.
+// The index is only built when it is first searched.
+static int loaded = 0;
+
+static struct postings *grams = NULL;
+static size_t grams_cap = 0, grams_used = 0;
+
+// Open addressing table from entry text to the id of its newest copy, plus
+// one; 0 marks an empty slot.
+static uint32_t *newest = NULL;
+static size_t newest_cap = 0, newest_used = 0;
+
+static void *xrealloc(void *pt, size_t size)
+{
+	pt = realloc(pt, size);
+	if (pt == NULL) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+	return pt;
+}
+
+static uint32_t hash_string(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static uint32_t hash_gram(uint32_t key)
+{
+	return key * 2654435761u;
+}
+
+static uint32_t gram_at(const char *s)
+{
+	return (uint32_t)(unsigned char)s[0] << 16 |
+	       (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+static struct postings *find_gram(uint32_t key, int create)
+{
+	size_t mask, i;
+
+	if (create && 2 * (grams_used + 1) > grams_cap) {
+		struct postings *old = grams;
+		size_t old_cap = grams_cap;
+
+		grams_cap = grams_cap ? 2 * grams_cap : 1024;
+		grams = calloc(grams_cap, sizeof(*grams));
+		if (grams == NULL) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < old_cap; i++) {
+			if (old[i].key == 0)
+				continue;
+			size_t j = hash_gram(old[i].key) & (grams_cap - 1);
+			while (grams[j].key != 0)
+				j = (j + 1) & (grams_cap - 1);
+			grams[j] = old[i];
+		}
+		free(old);
+	}
+	if (grams_cap == 0)
+		return NULL;
+
+	mask = grams_cap - 1;
+	for (i = hash_gram(key) & mask; grams[i].key != 0; i = (i + 1) & mask)
+		if (grams[i].key == key)
+			return &grams[i];
+	if (!create)
+		return NULL;
+
+	grams[i].key = key;
+	grams_used++;
+	return &grams[i];
+}
+
+// Return the slot of `line` in `newest`, which is empty if it is not there.
+static uint32_t *find_newest(const char *line)
+{
+	size_t mask = newest_cap - 1, i;
+
+	for (i = hash_string(line) & mask; newest[i] != 0; i = (i + 1) & mask)
+		if (strcmp(entries[newest[i] - 1], line) == 0)
+			break;
+	return &newest[i];
+}
+
+static void grow_newest(void)
+{
+	uint32_t *old = newest;
+	size_t old_cap = newest_cap;
+
+	newest_cap = newest_cap ? 2 * newest_cap : 1024;
+	newest = calloc(newest_cap, sizeof(*newest));
+	if (newest == NULL) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < old_cap; i++)
+		if (old[i] != 0)
+			*find_newest(entries[old[i] - 1]) = old[i];
+	free(old);
+}
+
+static void add_entry(const char *line)
+{
+	uint32_t id = n_entries, *slot;
+	size_t len = strlen(line);
+
+	if (n_entries == entries_cap) {
+		entries_cap = entries_cap ? 2 * entries_cap : 1024;
+		entries = xrealloc(entries, entries_cap * sizeof(*entries));
+		hidden = xrealloc(hidden, entries_cap);
+	}
+	entries[id] = xrealloc(NULL, len + 1);
+	memcpy(entries[id], line, len + 1);
+	hidden[id] = 0;
+	n_entries++;
+
+	if (2 * (newest_used + 1) > newest_cap)
+		grow_newest();
+	slot = find_newest(line);
+	if (*slot != 0)
+		hidden[*slot - 1] = 1;
+	else
+		newest_used++;
+	*slot = id + 1;
+
+	for (size_t i = 0; i + 3 <= len; i++) {
+		struct postings *p = find_gram(gram_at(line + i), 1);
+
+		// A trigram occurring twice in a line is only listed once.
+		if (p->n_ids > 0 && p->ids[p->n_ids - 1] == id)
+			continue;
+		if (p->n_ids == p->cap) {
+			p->cap = p->cap ? 2 * p->cap : 4;
+			p->ids = xrealloc(p->ids, p->cap * sizeof(*p->ids));
+		}
+		p->ids[p->n_ids++] = id;
+	}
+}
+
+void history_index_add(const char *line)
+{
+	// Until then, readline's history list has everything.
+	if (loaded)
+		add_entry(line);
+}
+
+void history_index_load(void)
+{
+	if (loaded)
+		return;
+	for (int i = 0; i < history_length; i++) {
+		HIST_ENTRY *h = history_get(history_base + i);
+
+		if (h != NULL)
+			add_entry(h->line);
+	}
+	loaded = 1;
+}
+
+static int matches(size_t id, const char *query)
+{
+	return !hidden[id] && strstr(entries[id], query) != NULL;
+}
+
+long history_index_search(const char *query, long before)
+{
+	size_t len = strlen(query), end, lo, hi;
+	struct postings *best = NULL;
+
+	end = n_entries;
+	if (before >= 0 && (size_t)before < n_entries)
+		end = before;
+
+	// Queries shorter than a trigram are common prefixes of what is typed;
+	// they match almost anything, so a scan stops quickly.
+	if (len < 3) {
+		while (end-- > 0)
+			if (matches(end, query))
+				return end;
+		return -1;
+	}
+
+	for (size_t i = 0; i + 3 <= len; i++) {
+		struct postings *p = find_gram(gram_at(query + i), 0);
+
+		if (p == NULL)
+			return -1;
+		if (best == NULL || p->n_ids < best->n_ids)
+			best = p;
+	}
+
+	// Skip the entries not older than `end`, then walk back in time.
+	lo = 0;
+	hi = best->n_ids;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (best->ids[mid] < end)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	while (lo-- > 0)
+		if (matches(best->ids[lo], query))
+			return best->ids[lo];
+	return -1;
+}
+
+const char *history_index_entry(long id)
+{
+	return id >= 0 && (size_t)id < n_entries ? entries[id] : NULL;
+}
+
+// The query of the last search, reused when a search is started and Ctrl-R
+// is pressed before anything is typed, as readline's own i-search does.
+static char *last_query = NULL;
+
+// Show the newest match for `query` older than entry `before` (or the newest
+// match if `before` is -1). Returns its id, or -1 if there is none.
+static long show_match(const char *query, long before)
+{
+	long id = history_index_search(query, before);
+
+	if (id >= 0) {
+		rl_replace_line(entries[id], 0);
+		rl_point = strstr(entries[id], query) - entries[id];
+	}
+	return id;
+}
+
+// Incremental reverse search through the index, with readline's i-search
+// keys: typed characters extend the query, Backspace shortens it, Ctrl-R
+// moves to the next older match, Ctrl-G restores the original line and Esc
+// keeps the match. Any other key keeps the match and is then handled as
+// usual, so Enter runs it.
+static int search_command(int count, int key)
+{
+	char *query, *saved_line;
+	size_t len = 0, cap = 64;
+	int saved_point = rl_point, failed = 0, c;
+	long match = -1, id;
+
+	(void)count;
+	(void)key;
+
+	history_index_load();
+	saved_line = xrealloc(NULL, rl_end + 1);
+	memcpy(saved_line, rl_line_buffer, rl_end);
+	saved_line[rl_end] = '\0';
+	query = xrealloc(NULL, cap);
+	query[0] = '\0';
+	rl_save_prompt();
+
+	for (;;) {
+		rl_message("(%sindex-search)`%s': ", failed ? "failed " : "",
+			   query);
+		c = rl_read_key();
+
+		if (c == EOF) {
+			break;
+		} else if (c == CTRL('G')) {
+			rl_replace_line(saved_line, 0);
+			rl_point = saved_point;
+			break;
+		} else if (c == CTRL('R')) {
+			// Ctrl-R on an empty query repeats the previous search.
+			if (len == 0 && last_query != NULL) {
+				len = strlen(last_query);
+				if (len + 1 > cap) {
+					cap = len + 1;
+					query = xrealloc(query, cap);
+				}
+				strcpy(query, last_query);
+			}
+			if (len == 0)
+				continue;
+			// Past the oldest match, stay on it.
+			id = show_match(query, match);
+		} else if (c == RUBOUT || c == CTRL('H')) {
+			if (len == 0)
+				continue;
+			query[--len] = '\0';
+			id = len ? show_match(query, -1) : -1;
+			match = id;
+			failed = len && id < 0;
+			if (len == 0) {
+				rl_replace_line(saved_line, 0);
+				rl_point = saved_point;
+			}
+			continue;
+		} else if (c == ESC) {
+			break;
+		} else if (c >= ' ' && c != RUBOUT) {
+			if (len + 2 > cap) {
+				cap *= 2;
+				query = xrealloc(query, cap);
+			}
+			query[len++] = c;
+			query[len] = '\0';
+			// The current match may still contain the longer query.
+			id = show_match(query, match >= 0 ? match + 1 : -1);
+		} else {
+			rl_execute_next(c);
+			break;
+		}
+
+		if (id < 0) {
+			rl_ding();
+			failed = 1;
+		} else {
+			match = id;
+			failed = 0;
+		}
+	}
+
+	rl_restore_prompt();
+	rl_clear_message();
+	if (len > 0) {
+		free(last_query);
+		last_query = query;
+	} else {
+		free(query);
+	}
+	free(saved_line);
+	return 0;
+}
+
+void history_index_bind(void)
+{
+	rl_bind_keyseq("\\C-r", &search_command);
+}
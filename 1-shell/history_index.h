@@ -0,0 +1,33 @@
+#ifndef HISTORY_INDEX_H
+#define HISTORY_INDEX_H
+
+// An in-memory index over the command history, so that searching a huge
+// history does not mean scanning all of it. Every entry is indexed by the
+// trigrams (three consecutive bytes) it contains; a search only looks at the
+// entries that contain the rarest trigram of the query.
+
+// Add `line` as the newest history entry. An older identical entry is hidden
+// from searches from then on, so that results are deduplicated. Does nothing
+// before `history_index_load`, which picks the entry up from readline.
+void history_index_add(const char *line);
+
+// Index every entry currently in readline's history list, unless that was
+// done before. The Ctrl-R binding does this on first use, so that a huge
+// history does not slow down startup.
+void history_index_load(void);
+
+// Return the newest entry older than entry `before` that contains `query`,
+// or -1 if there is none. Pass -1 as `before` to search from the newest
+// entry. Duplicates of newer entries are never returned.
+long history_index_search(const char *query, long before);
+
+// Return the text of entry `id`, as returned by `history_index_search`.
+const char *history_index_entry(long id);
+
+// Bind Ctrl-R to an incremental reverse search through the index, which
+// takes the same keys as readline's reverse-i-search: the line shows the
+// newest match of what has been typed so far, and pressing Ctrl-R again
+// moves to the next older match.
+void history_index_bind(void);
+
+#endif /* HISTORY_INDEX_H */
@@ -0,0 +1,570 @@
+#define _GNU_SOURCE
+#include "image.h"
+#include "hash.h"
+#include "parser/ast.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reference or string offset that stands for NULL.
+#define IMAGE_NONE UINT32_MAX
+
+struct image_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_commands;
+	uint64_t source_hash;
+	uint32_t n_nodes;
+	uint32_t n_refs;
+	uint32_t strings_size;
+	uint32_t source_path; // String offset, IMAGE_NONE if unknown.
+};
+
+// Followed in the file by:
+//   uint32_t commands[n_commands];    root node of every command line
+//   struct image_node nodes[n_nodes];
+//   uint32_t refs[n_refs];            node indices or string offsets
+//   char strings[strings_size];       NUL terminated, interned
+
+// Children always have a larger index than their parent, which keeps the
+// image acyclic. The meaning of `a`..`d` depends on the type:
+//   NODE_COMMAND   a: first ref (argv strings, NONE terminated), b: argc
+//   NODE_PIPE      a: first ref (part nodes), b: n_parts
+//   NODE_REDIRECT  a: child, b: fd, c: mode, d: fd2 or target string
+//   NODE_SUBSHELL  a: child
+//   NODE_DETACH    a: child
+//   NODE_SEQUENCE  a: first, b: second
+//   NODE_LIST      a: first ref (item nodes), b: n_items
+struct image_node {
+	uint32_t type;
+	int32_t a, b, c, d;
+};
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "r");
+	char *data = NULL;
+	size_t size = 0, n;
+
+	if (!f)
+		return NULL;
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? 2 * size : 4096;
+			data = realloc(data, size + 1);
+			if (!data)
+				exit(EXIT_FAILURE);
+		}
+		n = fread(data + *len, 1, size - *len, f);
+		*len += n;
+	} while (n > 0);
+
+	if (ferror(f)) {
+		free(data);
+		data = NULL;
+	} else {
+		data[*len] = '\0';
+	}
+	fclose(f);
+	return data;
+}
+
+/* Writing */
+
+struct writer {
+	struct image_node *nodes;
+	size_t n_nodes, nodes_cap;
+	uint32_t *refs;
+	size_t n_refs, refs_cap;
+	char *strings;
+	size_t strings_size, strings_cap;
+
+	// Open addressing table of string offsets + 1 (0 is an empty slot).
+	uint32_t *interned;
+	size_t interned_cap, n_interned;
+};
+
+static void *grow(void *pt, size_t *cap, size_t need, size_t member_size)
+{
+	if (need <= *cap)
+		return pt;
+	while (*cap < need)
+		*cap = *cap ? 2 * *cap : 64;
+	pt = realloc(pt, *cap * member_size);
+	if (!pt)
+		exit(EXIT_FAILURE);
+	return pt;
+}
+
+static void rehash(struct writer *w)
+{
+	size_t old_cap = w->interned_cap;
+	uint32_t *old = w->interned;
+
+	w->interned_cap = old_cap ? 2 * old_cap : 256;
+	w->interned = calloc(w->interned_cap, sizeof(uint32_t));
+	if (!w->interned)
+		exit(EXIT_FAILURE);
+
+	for (size_t i = 0; i < old_cap; i++) {
+		if (!old[i])
+			continue;
+		const char *s = w->strings + old[i] - 1;
+		size_t j = hash_fnv1a(s, strlen(s)) & (w->interned_cap - 1);
+		while (w->interned[j])
+			j = (j + 1) & (w->interned_cap - 1);
+		w->interned[j] = old[i];
+	}
+	free(old);
+}
+
+static uint32_t intern(struct writer *w, const char *s)
+{
+	size_t len = strlen(s), j;
+
+	if (2 * (w->n_interned + 1) > w->interned_cap)
+		rehash(w);
+
+	j = hash_fnv1a(s, len) & (w->interned_cap - 1);
+	while (w->interned[j]) {
+		if (strcmp(w->strings + w->interned[j] - 1, s) == 0)
+			return w->interned[j] - 1;
+		j = (j + 1) & (w->interned_cap - 1);
+	}
+
+	w->strings = grow(w->strings, &w->strings_cap,
+			  w->strings_size + len + 1, 1);
+	memcpy(w->strings + w->strings_size, s, len + 1);
+	w->interned[j] = w->strings_size + 1;
+	w->n_interned++;
+	w->strings_size += len + 1;
+	return w->interned[j] - 1;
+}
+
+static uint32_t add_node(struct writer *w)
+{
+	w->nodes = grow(w->nodes, &w->nodes_cap, w->n_nodes + 1,
+			sizeof(struct image_node));
+	memset(&w->nodes[w->n_nodes], 0, sizeof(struct image_node));
+	return w->n_nodes++;
+}
+
+static uint32_t add_ref(struct writer *w, uint32_t value)
+{
+	w->refs = grow(w->refs, &w->refs_cap, w->n_refs + 1, sizeof(uint32_t));
+	w->refs[w->n_refs] = value;
+	return w->n_refs++;
+}
+
+struct pending {
+	node_t *n;
+	uint32_t index;
+};
+
+// Flatten the tree `root` into `w` and return the index of its root node.
+// Iterative, as right-recursive sequences can be very deep.
+static uint32_t add_tree(struct writer *w, node_t *root)
+{
+	struct pending *stack = NULL;
+	size_t depth = 0, cap = 0;
+	uint32_t index = add_node(w);
+
+	stack = grow(stack, &cap, 1, sizeof(struct pending));
+	stack[depth++] = (struct pending){ root, index };
+
+	while (depth > 0) {
+		struct pending p = stack[--depth];
+		node_t *n = p.n;
+		struct image_node rec = { n->type, 0, 0, 0, 0 };
+		node_t *children[2] = { NULL, NULL }, **parts;
+		size_t i;
+
+		switch (n->type) {
+		case NODE_COMMAND:
+			rec.a = w->n_refs;
+			rec.b = n->command.argc;
+			for (i = 0; i < n->command.argc; i++)
+				add_ref(w, intern(w, n->command.argv[i]));
+			add_ref(w, IMAGE_NONE);
+			break;
+
+		case NODE_PIPE:
+		case NODE_LIST:
+			parts = n->type == NODE_PIPE ? n->pipe.parts :
+						       n->list.items;
+			rec.a = w->n_refs;
+			rec.b = n->type == NODE_PIPE ? n->pipe.n_parts :
+						       n->list.n_items;
+			for (i = 0; i < (size_t)rec.b; i++)
+				add_ref(w, 0);
+			stack = grow(stack, &cap, depth + rec.b,
+				     sizeof(struct pending));
+			for (i = 0; i < (size_t)rec.b; i++) {
+				uint32_t child = add_node(w);
+				w->refs[rec.a + i] = child;
+				stack[depth++] = (struct pending){ parts[i],
+								   child };
+			}
+			break;
+
+		case NODE_REDIRECT:
+			children[0] = n->redirect.child;
+			rec.b = n->redirect.fd;
+			rec.c = n->redirect.mode;
+			if (n->redirect.mode > 0)
+				rec.d = intern(w, n->redirect.target);
+			else
+				rec.d = n->redirect.fd2;
+			break;
+
+		case NODE_SUBSHELL:
+			children[0] = n->subshell.child;
+			break;
+
+		case NODE_DETACH:
+			children[0] = n->detach.child;
+			break;
+
+		case NODE_SEQUENCE:
+			children[0] = n->sequence.first;
+			children[1] = n->sequence.second;
+			break;
+		}
+
+		stack = grow(stack, &cap, depth + 2, sizeof(struct pending));
+		if (children[0]) {
+			rec.a = add_node(w);
+			stack[depth++] = (struct pending){ children[0], rec.a };
+		}
+		if (children[1]) {
+			rec.b = add_node(w);
+			stack[depth++] = (struct pending){ children[1], rec.b };
+		}
+		w->nodes[p.index] = rec;
+	}
+
+	free(stack);
+	return index;
+}
+
+static int write_image(FILE *out, struct writer *w, uint32_t *commands,
+		       size_t n_commands, uint64_t hash, const char *source)
+{
+	struct image_header h;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, IMAGE_MAGIC, sizeof(h.magic));
+	h.version = IMAGE_VERSION;
+	h.n_commands = n_commands;
+	h.source_hash = hash;
+	h.source_path = source ? intern(w, source) : IMAGE_NONE;
+	h.n_nodes = w->n_nodes;
+	h.n_refs = w->n_refs;
+	h.strings_size = w->strings_size;
+
+	if (fwrite(&h, sizeof(h), 1, out) != 1 ||
+	    fwrite(commands, sizeof(uint32_t), n_commands, out) != n_commands ||
+	    fwrite(w->nodes, sizeof(struct image_node), w->n_nodes, out) !=
+		    w->n_nodes ||
+	    fwrite(w->refs, sizeof(uint32_t), w->n_refs, out) != w->n_refs ||
+	    fwrite(w->strings, 1, w->strings_size, out) != w->strings_size ||
+	    fflush(out) != 0)
+		return -1;
+	return 0;
+}
+
+int image_compile(const char *source_path, FILE *out,
+		  int (*parse)(char *line, struct tree_node **out,
+			       const char **message))
+{
+	struct writer w;
+	uint32_t *commands = NULL;
+	size_t n_commands = 0, commands_cap = 0, len, line_no = 0;
+	char *source, *line, *next, *abs_path;
+	uint64_t hash;
+	int res = 0;
+
+	source = read_file(source_path, &len);
+	if (!source) {
+		perror(source_path);
+		return -1;
+	}
+	hash = hash_fnv1a(source, len);
+	memset(&w, 0, sizeof(w));
+
+	for (line = source; line < source + len && res == 0; line = next) {
+		node_t *n = NULL;
+		const char *message = NULL;
+		int error;
+
+		line_no++;
+		next = memchr(line, '\n', source + len - line);
+		if (next)
+			*next++ = '\0';
+		else
+			next = source + len;
+
+		error = parse(line, &n, &message);
+		if (message)
+			fprintf(stderr, "mysh: %s:%zu: %s\n",
+				source_path, line_no, message);
+		if (error) {
+			fprintf(stderr, "mysh: %s:%zu: syntax error\n",
+				source_path, line_no);
+			res = -1;
+		} else if (n) {
+			commands = grow(commands, &commands_cap, n_commands + 1,
+					sizeof(uint32_t));
+			commands[n_commands++] = add_tree(&w, n);
+			free_tree(n);
+		}
+	}
+
+	// The source is recorded with its absolute path, so that the image can
+	// be validated from any working directory.
+	abs_path = realpath(source_path, NULL);
+	if (res == 0 && write_image(out, &w, commands, n_commands,
+				    hash, abs_path) != 0) {
+		perror("write");
+		res = -1;
+	}
+
+	free(abs_path);
+	free(source);
+	free(commands);
+	free(w.nodes);
+	free(w.refs);
+	free(w.strings);
+	free(w.interned);
+	return res;
+}
+
+/* Loading */
+
+static int valid_string(const struct image_header *h, uint32_t offset)
+{
+	return offset < h->strings_size;
+}
+
+static int valid_node(const struct image_header *h, const uint32_t *refs,
+		      const struct image_node *rec, uint32_t index)
+{
+	uint64_t i;
+
+	switch (rec->type) {
+	case NODE_COMMAND:
+		if (rec->b < 1 || (uint64_t)(uint32_t)rec->a + rec->b >= h->n_refs)
+			return 0;
+		for (i = 0; i < (uint32_t)rec->b; i++)
+			if (!valid_string(h, refs[rec->a + i]))
+				return 0;
+		return refs[rec->a + rec->b] == IMAGE_NONE;
+
+	case NODE_PIPE:
+	case NODE_LIST:
+		if (rec->b < 1 || (uint64_t)(uint32_t)rec->a + rec->b > h->n_refs)
+			return 0;
+		for (i = 0; i < (uint32_t)rec->b; i++)
+			if (refs[rec->a + i] <= index ||
+			    refs[rec->a + i] >= h->n_nodes)
+				return 0;
+		return 1;
+
+	case NODE_REDIRECT:
+		if (rec->c < REDIRECT_DUP || rec->c > REDIRECT_APPEND)
+			return 0;
+		if (rec->c != REDIRECT_DUP && !valid_string(h, rec->d))
+			return 0;
+		/* fall through */
+	case NODE_SUBSHELL:
+	case NODE_DETACH:
+		return (uint32_t)rec->a > index && (uint32_t)rec->a < h->n_nodes;
+
+	case NODE_SEQUENCE:
+		return (uint32_t)rec->a > index && (uint32_t)rec->a < h->n_nodes &&
+		       (uint32_t)rec->b > index && (uint32_t)rec->b < h->n_nodes;
+	}
+	return 0;
+}
+
+// Point the `node_t` views at the mapped image.
+static void build_trees(struct image *img, const struct image_header *h,
+			const uint32_t *commands, const struct image_node *recs,
+			const uint32_t *refs, char *strings)
+{
+	node_t *nodes = img->trees;
+	void **ptrs = (void **)(nodes + h->n_nodes);
+	uint32_t i;
+
+	img->commands = (node_t **)(ptrs + h->n_refs);
+	for (i = 0; i < h->n_commands; i++)
+		img->commands[i] = &nodes[commands[i]];
+
+	for (i = 0; i < h->n_nodes; i++) {
+		const struct image_node *rec = &recs[i];
+		node_t *n = &nodes[i];
+		int32_t j;
+
+		n->type = rec->type;
+		n->flags = 0;
+		switch (n->type) {
+		case NODE_COMMAND:
+			for (j = 0; j < rec->b; j++)
+				ptrs[rec->a + j] = strings + refs[rec->a + j];
+			ptrs[rec->a + rec->b] = NULL;
+			n->command.argv = (char **)&ptrs[rec->a];
+			n->command.argc = rec->b;
+			n->command.program = n->command.argv[0];
+			break;
+
+		case NODE_PIPE:
+			for (j = 0; j < rec->b; j++)
+				ptrs[rec->a + j] = &nodes[refs[rec->a + j]];
+			n->pipe.parts = (node_t **)&ptrs[rec->a];
+			n->pipe.n_parts = rec->b;
+			break;
+
+		case NODE_LIST:
+			for (j = 0; j < rec->b; j++)
+				ptrs[rec->a + j] = &nodes[refs[rec->a + j]];
+			n->list.items = (node_t **)&ptrs[rec->a];
+			n->list.n_items = rec->b;
+			break;
+
+		case NODE_REDIRECT:
+			n->redirect.child = &nodes[rec->a];
+			n->redirect.fd = rec->b;
+			n->redirect.mode = rec->c;
+			if (rec->c > 0)
+				n->redirect.target = strings + rec->d;
+			else
+				n->redirect.fd2 = rec->d;
+			break;
+
+		case NODE_SUBSHELL:
+			n->subshell.child = &nodes[rec->a];
+			break;
+
+		case NODE_DETACH:
+			n->detach.child = &nodes[rec->a];
+			break;
+
+		case NODE_SEQUENCE:
+			n->sequence.first = &nodes[rec->a];
+			n->sequence.second = &nodes[rec->b];
+			break;
+		}
+	}
+}
+
+static enum image_status check_source(const struct image_header *h,
+				      const char *strings)
+{
+	size_t len;
+	char *source;
+	uint64_t hash;
+
+	if (h->source_path == IMAGE_NONE)
+		return IMAGE_OK;
+
+	source = read_file(strings + h->source_path, &len);
+	if (!source)
+		return errno == ENOENT ? IMAGE_OK : IMAGE_ERROR;
+	hash = hash_fnv1a(source, len);
+	free(source);
+	return hash == h->source_hash ? IMAGE_OK : IMAGE_STALE;
+}
+
+static enum image_status map_image(struct image *img)
+{
+	const struct image_header *h = img->map;
+	const uint32_t *commands, *refs;
+	const struct image_node *recs;
+	char *strings;
+	uint64_t size;
+	enum image_status res;
+
+	if (img->map_size < sizeof(*h) ||
+	    memcmp(h->magic, IMAGE_MAGIC, sizeof(h->magic)) != 0)
+		return IMAGE_NOT_IMAGE;
+	if (h->version != IMAGE_VERSION)
+		return IMAGE_ERROR;
+
+	size = sizeof(*h) + (uint64_t)h->n_commands * sizeof(uint32_t) +
+	       (uint64_t)h->n_nodes * sizeof(struct image_node) +
+	       (uint64_t)h->n_refs * sizeof(uint32_t) + h->strings_size;
+	if (size != img->map_size)
+		return IMAGE_ERROR;
+
+	commands = (const uint32_t *)(h + 1);
+	recs = (const struct image_node *)(commands + h->n_commands);
+	refs = (const uint32_t *)(recs + h->n_nodes);
+	strings = (char *)(refs + h->n_refs);
+
+	if (h->strings_size > 0 && strings[h->strings_size - 1] != '\0')
+		return IMAGE_ERROR;
+	if (h->source_path != IMAGE_NONE && !valid_string(h, h->source_path))
+		return IMAGE_ERROR;
+	for (uint32_t i = 0; i < h->n_commands; i++)
+		if (commands[i] >= h->n_nodes)
+			return IMAGE_ERROR;
+	for (uint32_t i = 0; i < h->n_nodes; i++)
+		if (!valid_node(h, refs, &recs[i], i))
+			return IMAGE_ERROR;
+
+	res = check_source(h, strings);
+	if (res != IMAGE_OK)
+		return res;
+
+	img->trees = malloc(h->n_nodes * sizeof(node_t) +
+			    h->n_refs * sizeof(void *) +
+			    h->n_commands * sizeof(node_t *) + 1);
+	if (!img->trees)
+		exit(EXIT_FAILURE);
+	img->n_commands = h->n_commands;
+	build_trees(img, h, commands, recs, refs, strings);
+	return IMAGE_OK;
+}
+
+enum image_status image_open(const char *path, struct image *img)
+{
+	struct stat st;
+	enum image_status res;
+	int fd;
+
+	memset(img, 0, sizeof(*img));
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return IMAGE_NOT_IMAGE;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return IMAGE_NOT_IMAGE;
+	}
+
+	img->map_size = st.st_size;
+	img->map = mmap(NULL, img->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (img->map == MAP_FAILED) {
+		img->map = NULL;
+		return IMAGE_ERROR;
+	}
+
+	res = map_image(img);
+	if (res != IMAGE_OK)
+		image_close(img);
+	return res;
+}
+
+void image_close(struct image *img)
+{
+	if (img->map)
+		munmap(img->map, img->map_size);
+	free(img->trees);
+	memset(img, 0, sizeof(*img));
+}
@@ -0,0 +1,52 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct tree_node;
+
+// A compiled script ("42c image") is a flat, position independent copy of the
+// command trees of a script: an array of nodes referring to each other by
+// index, an array of references (argv entries and pipe parts) and a table of
+// interned strings. It is mapped read-only and turned into `node_t` trees
+// that point straight into the mapping, so no lexing, parsing or per-node
+// allocation happens when it is run.
+
+#define IMAGE_MAGIC "42sh-img"
+#define IMAGE_VERSION 1
+
+enum image_status {
+	IMAGE_OK,
+	IMAGE_NOT_IMAGE, // Not a compiled script (or not a readable file).
+	IMAGE_STALE,     // The source the image was compiled from has changed.
+	IMAGE_ERROR      // The file could not be read or is corrupt.
+};
+
+struct image {
+	struct tree_node **commands; // One tree per command line.
+	size_t n_commands;
+
+	// Private to image.c.
+	void *map;
+	size_t map_size;
+	void *trees;
+};
+
+// Parse the script at `source_path` line by line with `parse` (which behaves
+// like `pipeline_parse_fun`) and write its image to `out`. Returns 0 on
+// success; on failure an error has been printed and -1 is returned.
+int image_compile(const char *source_path, FILE *out,
+		  int (*parse)(char *line, struct tree_node **out,
+			       const char **message));
+
+// Map the image at `path`. On IMAGE_OK `img` is filled in and must be
+// released with `image_close`. If the source file recorded in the image still
+// exists, its contents must match the recorded hash.
+enum image_status image_open(const char *path, struct image *img);
+
+// Unmap an image opened with `image_open`. Its trees must not be passed to
+// `free_tree`.
+void image_close(struct image *img);
+
+#endif /* IMAGE_H */
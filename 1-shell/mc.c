@@ -7,13 +7,34 @@ struct m_node {
 	struct m_node *next;
 	void *pt;
 	free_fun fun;
+	size_t size; // 0 unless allocated by the mc itself
 };
 
 struct mc {
 	m_node *header;
 	size_t n;
+	size_t bytes; // Allocated by the mc itself and not yet freed.
+	size_t allocs;
 };
 
+struct mc_stats mc_stats;
+
+static void count_alloc(mc *m, size_t size)
+{
+	m->bytes += size;
+	m->allocs++;
+	mc_stats.allocs++;
+	mc_stats.live_bytes += size;
+	if (mc_stats.live_bytes > mc_stats.peak_bytes)
+		mc_stats.peak_bytes = mc_stats.live_bytes;
+}
+
+static void count_free(mc *m, size_t size)
+{
+	m->bytes -= size;
+	mc_stats.live_bytes -= size;
+}
+
 mc *mc_init()
 {
 	mc *res = malloc(sizeof(mc));
@@ -21,6 +42,8 @@ mc *mc_init()
 		exit(EXIT_FAILURE);
 	res->n = 0;
 	res->header = NULL;
+	res->bytes = 0;
+	res->allocs = 0;
 	return res;
 }
 
@@ -40,20 +63,22 @@ static void assert_new_pt(mc *m, void *pt)
 static void *alloc_mem(mc *m, size_t nmemb, size_t member_size, int use_calloc)
 {
 	void *res;
+	size_t size;
 
 	if (nmemb == 0 || member_size == 0)
 		return NULL;
 
+	size = nmemb * member_size;
+	assert(size / nmemb == member_size);
 	if (use_calloc) {
 		res = calloc(nmemb, member_size);
 	} else {
-		size_t size;
-		size = nmemb * member_size;
-		assert(size / nmemb == member_size);
 		res = malloc(size);
 	}
 
 	mc_register_mem(m, res, &free);
+	m->header->size = size;
+	count_alloc(m, size);
 	return res;
 }
 
@@ -82,6 +107,7 @@ void mc_register_mem(mc *m, void *pt, const free_fun fun)
 
 	new_node->fun = fun;
 	new_node->pt = pt;
+	new_node->size = 0;
 	new_node->next = m->header;
 	m->header = new_node;
 	m->n++;
@@ -90,6 +116,7 @@ void mc_register_mem(mc *m, void *pt, const free_fun fun)
 void mc_free_all_mem(mc *m)
 {
 	m_node *cur = m->header, *next;
+	count_free(m, m->bytes);
 	for (size_t i = 0; i < m->n; i++) {
 		next = cur->next;
 		cur->fun(cur->pt);
@@ -102,6 +129,7 @@ void mc_free_all_mem(mc *m)
 void mc_unregister_all_mem(mc *m)
 {
 	m_node *cur = m->header, *next;
+	count_free(m, m->bytes);
 	for (size_t i = 0; i < m->n; i++) {
 		next = cur->next;
 		free(cur);
@@ -116,11 +144,13 @@ m_node *mc_unregister_mem(mc *m, const void *pt)
 	m->n--;
 	if (pt == prev->pt) {
 		m->header = cur;
+		count_free(m, prev->size);
 		return prev;
 	}
 	for (size_t i = 0; i < m->n; i++) {
 		if (pt == cur->pt) {
 			prev->next = cur->next;
+			count_free(m, cur->size);
 			return cur;
 		}
 		prev = cur;
@@ -135,3 +165,13 @@ void mc_free_mem(mc *m, void *pt)
 	to_free->fun(to_free->pt);
 	free(to_free);
 }
+
+size_t mc_bytes(const mc *m)
+{
+	return m->bytes;
+}
+
+size_t mc_allocs(const mc *m)
+{
+	return m->allocs;
+}
@@ -49,4 +49,20 @@ void *mc_malloc(mc *m, size_t nmemb, size_t member_size);
 // returned.
 void *mc_calloc(mc *m, size_t nmemb, size_t member_size);
 
+// Totals over all mc's of the memory allocated by `mc_malloc` and
+// `mc_calloc`. Memory registered with `mc_register_mem` is not counted.
+struct mc_stats {
+	size_t live_bytes; // Allocated and not yet freed.
+	size_t peak_bytes; // Highest value `live_bytes` has had.
+	size_t allocs;     // Number of allocations ever made.
+};
+
+extern struct mc_stats mc_stats;
+
+// Bytes currently allocated by `m` itself.
+size_t mc_bytes(const mc *m);
+
+// Number of allocations made by `m` itself.
+size_t mc_allocs(const mc *m);
+
 #endif
@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "hash.h"
+#include "memo.h"
+#include "path_index.h"
+
+#define MEMO_MAGIC "42sh-mem"
+#define MEMO_VERSION 1
+
+extern char **environ;
+
+/*
+ * A cache entry is this header followed by the key, the stdout and the
+ * stderr of the command. The key is stored in full so that hash collisions
+ * are noticed.
+ */
+struct memo_header {
+    char magic[8];
+    uint32_t version;
+    int32_t status;
+    uint64_t key_len;
+    uint64_t out_len;
+    uint64_t err_len;
+};
+
+struct buf {
+    char *data;
+    size_t len, cap;
+};
+
+static void buf_add(struct buf *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        while (b->len + len > b->cap)
+            b->cap = b->cap ? 2 * b->cap : 1024;
+        b->data = realloc(b->data, b->cap);
+        if (b->data == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void buf_add_str(struct buf *b, const char *s) {
+    buf_add(b, s, strlen(s) + 1);
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Everything the result may depend on: argv, the working directory, a hash
+ * of the environment and the identity and mtime of every -f file. Returns
+ * -1 if a dependency cannot be examined.
+ */
+static int make_key(struct buf *key, char **cmd, char **deps, size_t n_deps) {
+    char *cwd = getcwd(NULL, 0);
+    uint64_t env = 0;
+    char line[128];
+
+    buf_add_str(key, "argv");
+    for (char **a = cmd; *a; a++)
+        buf_add_str(key, *a);
+    buf_add_str(key, "cwd");
+    buf_add_str(key, cwd ? cwd : "");
+    free(cwd);
+
+    // Summed, so that the order of the variables does not matter
+    for (char **e = environ; *e; e++)
+        env += hash_fnv1a(*e, strlen(*e));
+    snprintf(line, sizeof(line), "env %016" PRIx64, env);
+    buf_add_str(key, line);
+
+    for (size_t i = 0; i < n_deps; i++) {
+        struct stat st;
+
+        if (stat(deps[i], &st) == -1) {
+            perror(deps[i]);
+            return -1;
+        }
+        buf_add_str(key, deps[i]);
+        snprintf(line, sizeof(line), "%ju %ju %jd %jd.%09ld",
+                 (uintmax_t)st.st_dev, (uintmax_t)st.st_ino,
+                 (intmax_t)st.st_size, (intmax_t)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec);
+        buf_add_str(key, line);
+    }
+    return 0;
+}
+
+/*
+ * The cache directory, created if needed; NULL if there is none.
+ */
+static char *cache_dir(void) {
+    const char *base = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char *dir;
+
+    if (base != NULL && base[0] == '/') {
+        if (asprintf(&dir, "%s/42sh-memo", base) == -1)
+            return NULL;
+    } else if (home == NULL || asprintf(&dir, "%s/.cache/42sh-memo", home) == -1) {
+        return NULL;
+    }
+
+    // Create the parent as well, it may not exist yet
+    *strrchr(dir, '/') = '\0';
+    mkdir(dir, 0700);
+    dir[strlen(dir)] = '/';
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+/*
+ * Write out the entry in `fd` if it is valid for `key`. Returns the exit
+ * status it holds, or -1.
+ */
+static int replay(int fd, const struct buf *key) {
+    const struct memo_header *h;
+    struct stat st;
+    const char *p;
+    int status = -1;
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(*h))
+        return -1;
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return -1;
+
+    h = (const struct memo_header *)p;
+    if (memcmp(h->magic, MEMO_MAGIC, sizeof(h->magic)) == 0 &&
+        h->version == MEMO_VERSION && h->key_len == key->len &&
+        h->out_len <= (uint64_t)st.st_size &&
+        h->err_len <= (uint64_t)st.st_size &&
+        sizeof(*h) + h->key_len + h->out_len + h->err_len == (uint64_t)st.st_size &&
+        memcmp(p + sizeof(*h), key->data, key->len) == 0) {
+        const char *out = p + sizeof(*h) + h->key_len;
+
+        fflush(NULL);
+        write_all(STDOUT_FILENO, out, h->out_len);
+        write_all(STDERR_FILENO, out + h->out_len, h->err_len);
+        status = h->status;
+    }
+    munmap((void *)p, st.st_size);
+    return status;
+}
+
+static int temp_file(const char *dir, const char *prefix, char **name) {
+    int fd;
+
+    if (asprintf(name, "%s/%s.XXXXXX", dir, prefix) == -1)
+        return -1;
+    fd = mkostemp(*name, O_CLOEXEC);
+    if (fd == -1) {
+        free(*name);
+        *name = NULL;
+    }
+    return fd;
+}
+
+static int copy_fd(int to, int from, uint64_t *len) {
+    char chunk[65536];
+    ssize_t n;
+
+    *len = 0;
+    if (lseek(from, 0, SEEK_SET) == -1)
+        return -1;
+    while ((n = read(from, chunk, sizeof(chunk))) > 0) {
+        if (write_all(to, chunk, n) == -1)
+            return -1;
+        *len += n;
+    }
+    return n;
+}
+
+/*
+ * Run `cmd` with its output going to `out` and `err`. Returns its wait
+ * status, or -1.
+ */
+static int capture(char **cmd, int out, int err) {
+    const char *path = path_index_lookup(cmd[0]);
+    int status;
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        if (path != NULL)
+            execv(path, cmd);
+        execvp(cmd[0], cmd);
+        perror("execvp");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    waitpid(pid, &status, 0);
+    return status;
+}
+
+/*
+ * Run `cmd`, store its result under `entry` and replay it. Without a cache
+ * directory the command simply runs.
+ */
+static int run_and_store(char **cmd, const char *dir, const char *entry,
+                         const struct buf *key) {
+    char *out_name = NULL, *err_name = NULL, *tmp_name = NULL;
+    int out = -1, err = -1, tmp = -1, status = -1, wstatus;
+    struct memo_header h;
+
+    if (dir != NULL) {
+        out = temp_file(dir, "out", &out_name);
+        err = temp_file(dir, "err", &err_name);
+        tmp = temp_file(dir, "new", &tmp_name);
+    }
+    if (out == -1 || err == -1 || tmp == -1) {
+        // Nowhere to keep the result
+        wstatus = capture(cmd, STDOUT_FILENO, STDERR_FILENO);
+        status = wstatus != -1 && WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+        goto out;
+    }
+    unlink(out_name);
+    unlink(err_name);
+
+    wstatus = capture(cmd, out, err);
+    if (wstatus == -1)
+        goto out;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MEMO_MAGIC, sizeof(h.magic));
+    h.version = MEMO_VERSION;
+    h.status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+    h.key_len = key->len;
+    if (write_all(tmp, (char *)&h, sizeof(h)) == -1 ||
+        write_all(tmp, key->data, key->len) == -1 ||
+        copy_fd(tmp, out, &h.out_len) == -1 ||
+        copy_fd(tmp, err, &h.err_len) == -1 ||
+        pwrite(tmp, &h, sizeof(h), 0) != sizeof(h)) {
+        perror("memo");
+        goto out;
+    }
+
+    // Killed commands are not cached, but their output is still shown
+    if (!WIFEXITED(wstatus) || rename(tmp_name, entry) == -1)
+        unlink(tmp_name);
+    status = replay(tmp, key);
+    if (!WIFEXITED(wstatus))
+        status = -1;
+    free(tmp_name);
+    tmp_name = NULL;
+
+out:
+    if (tmp_name != NULL)
+        unlink(tmp_name);
+    free(out_name);
+    free(err_name);
+    free(tmp_name);
+    if (out != -1)
+        close(out);
+    if (err != -1)
+        close(err);
+    if (tmp != -1)
+        close(tmp);
+    return status;
+}
+
+int memo_run(char **argv) {
+    char **cmd = argv + 1, **deps = NULL, *dir, *entry = NULL;
+    size_t n_deps = 0;
+    struct buf key = { NULL, 0, 0 };
+    int status = -1, fd;
+
+    while (*cmd != NULL && strcmp(*cmd, "-f") == 0) {
+        if (cmd[1] == NULL)
+            break;
+        deps = realloc(deps, (n_deps + 1) * sizeof(char *));
+        if (deps == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        deps[n_deps++] = cmd[1];
+        cmd += 2;
+    }
+    if (*cmd != NULL && strcmp(*cmd, "--") == 0)
+        cmd++;
+    if (*cmd == NULL) {
+        fprintf(stderr, "usage: memo [-f FILE]... COMMAND [ARG]...\n");
+        free(deps);
+        return 2;
+    }
+
+    if (make_key(&key, cmd, deps, n_deps) == -1) {
+        free(deps);
+        free(key.data);
+        return 1;
+    }
+
+    dir = cache_dir();
+    if (dir != NULL &&
+        asprintf(&entry, "%s/%016" PRIx64, dir, hash_fnv1a(key.data, key.len)) == -1)
+        entry = NULL;
+    if (entry != NULL && (fd = open(entry, O_RDONLY | O_CLOEXEC)) != -1) {
+        status = replay(fd, &key);
+        close(fd);
+    }
+    if (status == -1)
+        status = run_and_store(cmd, entry ? dir : NULL, entry, &key);
+
+    if (status > 0)
+        fprintf(stderr, "%s: command failed with exit status %d\n", cmd[0], status);
+    free(entry);
+    free(dir);
+    free(deps);
+    free(key.data);
+    return status;
+}
@@ -0,0 +1,24 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+/*
+ * The `memo` built-in: `memo [-f FILE]... COMMAND [ARG]...` runs COMMAND
+ * once and replays its stdout, stderr and exit status from then on, as long
+ * as the arguments, the working directory, the environment and the files
+ * given with -f stay the same. Meant for slow commands that only inspect
+ * their surroundings, such as `uname -a` or `git rev-parse HEAD`.
+ *
+ * Results are kept as one file per key under $XDG_CACHE_HOME/42sh-memo (or
+ * ~/.cache/42sh-memo), written under a temporary name and renamed into
+ * place, so shells running at the same time can share them. A hit maps the
+ * file and writes it out without spawning anything. Output of a miss only
+ * appears once the command has finished.
+ */
+
+/*
+ * Run the built-in with `argv` (starting at "memo"). Prints the usual
+ * message if COMMAND fails and returns its exit status.
+ */
+int memo_run(char **argv);
+
+#endif
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "arena.h"
+#include "memstat.h"
+#include "parser/ast.h"
+#include "parser/lexer.h"
+
+// Arenas listed one by one; deeper ones are only counted
+#define MEMSTAT_MAX_ARENAS 16
+
+static size_t commands = 0;
+static size_t last_nodes = 0, last_bytes = 0;
+static size_t max_nodes = 0, max_bytes = 0;
+static size_t total_nodes = 0, total_bytes = 0;
+
+static pid_t report_pid = 0;
+
+void memstat_command(node_t *n)
+{
+    size_t nodes, bytes;
+
+    tree_stats(n, &nodes, &bytes);
+    commands++;
+    last_nodes = nodes;
+    last_bytes = bytes;
+    total_nodes += nodes;
+    total_bytes += bytes;
+    if (nodes > max_nodes)
+        max_nodes = nodes;
+    if (bytes > max_bytes)
+        max_bytes = bytes;
+}
+
+void memstat_print(FILE *out)
+{
+    struct arena_stat stats[MEMSTAT_MAX_ARENAS];
+    size_t n = arena_stats(stats, MEMSTAT_MAX_ARENAS);
+
+    fprintf(out, "memstat: %zu arenas live, %zu peak\n",
+            arena_amount(), arena_peak_amount());
+    for (size_t i = 0; i < n; i++)
+        fprintf(out, "memstat:   arena %zu: %zu bytes in %zu allocations\n",
+                i, stats[i].bytes, stats[i].allocs);
+    fprintf(out, "memstat: all mc memory %zu bytes live, %zu peak, "
+            "%zu allocations\n",
+            mc_stats.live_bytes, mc_stats.peak_bytes, mc_stats.allocs);
+    fprintf(out, "memstat: ast %zu nodes live, %zu made\n",
+            ast_stats.nodes_live, ast_stats.nodes_made);
+    if (commands > 0)
+        fprintf(out, "memstat: ast per command: %zu parsed, "
+                "last %zu nodes/%zu bytes, largest %zu nodes/%zu bytes, "
+                "mean %zu nodes/%zu bytes\n",
+                commands, last_nodes, last_bytes, max_nodes, max_bytes,
+                total_nodes / commands, total_bytes / commands);
+    fprintf(out, "memstat: lexer string_buf %zu bytes, %zu peak\n",
+            string_buf_len, string_buf_peak);
+}
+
+static void memstat_report(void)
+{
+    if (report_pid != getpid())
+        return;
+
+    memstat_print(stderr);
+}
+
+void memstat_report_at_exit(void)
+{
+    report_pid = getpid();
+    atexit(&memstat_report);
+}
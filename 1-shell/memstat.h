@@ -0,0 +1,25 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stdio.h>
+
+struct tree_node;
+
+/*
+ * Record the size of a freshly parsed command tree.
+ */
+void memstat_command(struct tree_node *n);
+
+/*
+ * Print the memory counters of the arenas, the command trees and the lexer
+ * to `out`. Used by the `memstat` built-in.
+ */
+void memstat_print(FILE *out);
+
+/*
+ * Print the memory counters on standard error when the shell exits (but
+ * not when its forked children do).
+ */
+void memstat_report_at_exit(void);
+
+#endif
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "optimize.h"
+#include "parser/ast.h"
+#include "shell.h"
+
+struct opt_stats opt_stats;
+
+static pid_t report_pid = 0;
+
+static void *xrealloc(void *pt, size_t size)
+{
+    pt = realloc(pt, size);
+    if (pt == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return pt;
+}
+
+static node_t *optimize(node_t *n);
+
+/*
+ * Fold the sequence rooted at `n` into a single NODE_LIST. Walks the chain
+ * with an explicit stack, since `a; b; c; ...` nests to the right once per
+ * command.
+ */
+static node_t *flatten(node_t *n)
+{
+    node_t **stack = NULL, **items = NULL, *list;
+    size_t depth = 0, stack_cap = 0, n_items = 0, items_cap = 0;
+
+    stack = xrealloc(stack, (stack_cap = 16) * sizeof(node_t *));
+    stack[depth++] = n;
+
+    while (depth > 0) {
+        node_t *cur = stack[--depth];
+
+        if (cur->type == NODE_SEQUENCE) {
+            if (depth + 2 > stack_cap)
+                stack = xrealloc(stack, (stack_cap *= 2) * sizeof(node_t *));
+            stack[depth++] = cur->sequence.second;
+            stack[depth++] = cur->sequence.first;
+            free(cur);
+            ast_stats.nodes_live--;
+            opt_stats.sequences_flattened++;
+            continue;
+        }
+
+        if (n_items == items_cap) {
+            items_cap = items_cap ? 2 * items_cap : 4;
+            items = xrealloc(items, items_cap * sizeof(node_t *));
+        }
+        items[n_items++] = optimize(cur);
+    }
+    free(stack);
+
+    list = xrealloc(NULL, sizeof(node_t));
+    ast_stats.nodes_made++;
+    ast_stats.nodes_live++;
+    list->type = NODE_LIST;
+    list->flags = NODE_SPAWN_ONLY;
+    list->list.items = xrealloc(items, n_items * sizeof(node_t *));
+    list->list.n_items = n_items;
+    for (size_t i = 0; i < n_items; i++)
+        list->flags &= items[i]->flags;
+    opt_stats.lists_built++;
+    return list;
+}
+
+static node_t *optimize(node_t *n)
+{
+    node_t **child = NULL;
+    size_t i;
+
+    switch (n->type) {
+    case NODE_COMMAND:
+        if (!is_builtin(n->command.program)) {
+            n->flags |= NODE_SPAWN_ONLY;
+            opt_stats.spawn_only++;
+        }
+        return n;
+
+    case NODE_SEQUENCE:
+        return flatten(n);
+
+    case NODE_LIST:
+        n->flags = NODE_SPAWN_ONLY;
+        for (i = 0; i < n->list.n_items; i++) {
+            n->list.items[i] = optimize(n->list.items[i]);
+            n->flags &= n->list.items[i]->flags;
+        }
+        return n;
+
+    case NODE_PIPE:
+        if (n->pipe.n_parts == 1) {
+            node_t *part = n->pipe.parts[0];
+            free(n->pipe.parts);
+            free(n);
+            ast_stats.nodes_live--;
+            opt_stats.pipes_unwrapped++;
+            opt_stats.pipe_forks_saved++;
+            return optimize(part);
+        }
+        n->flags = NODE_SPAWN_ONLY;
+        for (i = 0; i < n->pipe.n_parts; i++) {
+            n->pipe.parts[i] = optimize(n->pipe.parts[i]);
+            n->flags &= n->pipe.parts[i]->flags;
+        }
+        return n;
+
+    case NODE_REDIRECT:
+        child = &n->redirect.child;
+        break;
+
+    case NODE_SUBSHELL:
+        child = &n->subshell.child;
+        break;
+
+    case NODE_DETACH:
+        child = &n->detach.child;
+        break;
+    }
+
+    *child = optimize(*child);
+    n->flags = (*child)->flags;
+    return n;
+}
+
+node_t *optimize_tree(node_t *n)
+{
+    return n ? optimize(n) : NULL;
+}
+
+static void optimize_report(void)
+{
+    if (report_pid != getpid())
+        return;
+
+    fprintf(stderr,
+            "optimizer: %zu sequences flattened into %zu lists\n"
+            "optimizer: %zu single-part pipes unwrapped, saved %zu forks\n"
+            "optimizer: %zu spawn-only commands, saved %zu forks\n"
+            "optimizer: %zu subshells run without forking\n",
+            opt_stats.sequences_flattened, opt_stats.lists_built,
+            opt_stats.pipes_unwrapped, opt_stats.pipe_forks_saved,
+            opt_stats.spawn_only, opt_stats.spawn_forks_saved,
+            opt_stats.subshell_forks_saved);
+}
+
+void optimize_report_at_exit(void)
+{
+    report_pid = getpid();
+    atexit(&optimize_report);
+}
@@ -0,0 +1,39 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <stddef.h>
+
+struct tree_node;
+
+/*
+ * Counters kept by the optimizer and by the executor's fast paths.
+ */
+struct opt_stats {
+    size_t sequences_flattened; // NODE_SEQUENCE nodes folded into a list
+    size_t lists_built;         // NODE_LIST nodes created
+    size_t pipes_unwrapped;     // single-part pipes replaced by their part
+    size_t spawn_only;          // command nodes marked NODE_SPAWN_ONLY
+
+    size_t pipe_forks_saved;    // forks saved by unwrapping pipes
+    size_t spawn_forks_saved;   // forks saved by exec'ing pipe parts directly
+    size_t subshell_forks_saved; // subshells run inside the shell process
+};
+
+extern struct opt_stats opt_stats;
+
+/*
+ * Rewrite the tree `n` for execution and return its new root. Chains of
+ * NODE_SEQUENCE nodes (including `{ ... }` groups inside a sequence, which
+ * the grammar passes through as nested sequences) become one NODE_LIST,
+ * single-part pipes become their part, and nodes without any built-in are
+ * marked NODE_SPAWN_ONLY. Replaced nodes are freed.
+ */
+struct tree_node *optimize_tree(struct tree_node *n);
+
+/*
+ * Print the optimizer counters on standard error when the shell exits (but
+ * not when its forked children do).
+ */
+void optimize_report_at_exit(void);
+
+#endif
@@ -6,10 +6,20 @@
 #include <stdio.h>
 #include <ctype.h>
 
+struct ast_stats ast_stats;
+
+static node_t *alloc_node(void)
+{
+    ast_stats.nodes_made++;
+    ast_stats.nodes_live++;
+    return malloc(sizeof(node_t));
+}
+
 node_t *make_redir(node_t *child, int fd, int mode, int fd2, char *target)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = alloc_node();
     n->type = NODE_REDIRECT;
+    n->flags = 0;
     n->redirect.child = child;
     n->redirect.fd = fd;
     n->redirect.mode = mode;
@@ -24,8 +34,9 @@ node_t *make_redir(node_t *child, int fd, int mode, int fd2, char *target)
 
 node_t *make_simple(char *prog)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = alloc_node();
     n->type = NODE_COMMAND;
+    n->flags = 0;
     n->command.program = prog;
     n->command.argv = malloc(2 * sizeof(char *));
     n->command.argv[0] = strdup(prog);
@@ -47,8 +58,9 @@ node_t *extend_simple(node_t *cmd, char *extra)
 
 node_t *make_pipe(node_t *first, node_t *second)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = alloc_node();
     n->type = NODE_PIPE;
+    n->flags = 0;
     n->pipe.n_parts = 2;
     n->pipe.parts = malloc(2 * sizeof(node_t *));
     n->pipe.parts[0] = first;
@@ -67,24 +79,27 @@ node_t *extend_pipe(node_t *n, node_t *extra)
 
 node_t *make_subshell(node_t *child)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = alloc_node();
     n->type = NODE_SUBSHELL;
+    n->flags = 0;
     n->subshell.child = child;
     return n;
 }
 
 node_t *make_detach(node_t *child)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = alloc_node();
     n->type = NODE_DETACH;
+    n->flags = 0;
     n->detach.child = child;
     return n;
 }
 
 node_t *make_seq(node_t *left, node_t *right)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = alloc_node();
     n->type = NODE_SEQUENCE;
+    n->flags = 0;
     n->sequence.first = left;
     n->sequence.second = right;
     return n;
@@ -181,6 +196,15 @@ void print_tree_flat(node_t *n, int nl)
         print_tree_flat(n->sequence.second, 0);
         printf(" } ");
         break;
+
+    case NODE_LIST:
+        for (i = 0; i < n->list.n_items; ++i) {
+            printf(i > 0 ? "; { " : " { ");
+            print_tree_flat(n->list.items[i], 0);
+            printf(" }");
+        }
+        putchar(' ');
+        break;
     }
 
     if (nl)
@@ -257,6 +281,12 @@ static void print_tree_rec(node_t *n, int ind)
         print_tree_rec(n->sequence.first, ind + 1);
         print_tree_rec(n->sequence.second, ind + 1);
         break;
+
+    case NODE_LIST:
+        printf("LIST\n");
+        for (i = 0; i < n->list.n_items; ++i)
+            print_tree_rec(n->list.items[i], ind + 1);
+        break;
     }
 }
 
@@ -270,6 +300,15 @@ void free_tree(node_t *n)
 {
     size_t i;
 
+    /* Sequences nest to the right; free their chain without recursing. */
+    while (n && n->type == NODE_SEQUENCE) {
+        node_t *second = n->sequence.second;
+        free_tree(n->sequence.first);
+        free(n);
+        ast_stats.nodes_live--;
+        n = second;
+    }
+
     if (!n)
         return;
 
@@ -302,9 +341,78 @@ void free_tree(node_t *n)
         break;
 
     case NODE_SEQUENCE:
-        free_tree(n->sequence.first);
-        free_tree(n->sequence.second);
+        break;
+
+    case NODE_LIST:
+        for (i = 0; i < n->list.n_items; ++i)
+            free_tree(n->list.items[i]);
+        free(n->list.items);
         break;
     }
     free(n);
+    ast_stats.nodes_live--;
+}
+
+void tree_stats(node_t *n, size_t *nodes, size_t *bytes)
+{
+    node_t **stack = NULL;
+    size_t depth = 0, cap = 0, i;
+
+    *nodes = *bytes = 0;
+    while (n) {
+        node_t *more[2] = { NULL, NULL };
+        node_t **children = more;
+        size_t n_children = 0;
+
+        ++*nodes;
+        *bytes += sizeof(node_t);
+
+        switch (n->type) {
+        case NODE_COMMAND:
+            *bytes += strlen(n->command.program) + 1;
+            *bytes += (n->command.argc + 1) * sizeof(char *);
+            for (i = 0; i < n->command.argc; ++i)
+                *bytes += strlen(n->command.argv[i]) + 1;
+            break;
+        case NODE_PIPE:
+            *bytes += n->pipe.n_parts * sizeof(node_t *);
+            children = n->pipe.parts;
+            n_children = n->pipe.n_parts;
+            break;
+        case NODE_LIST:
+            *bytes += n->list.n_items * sizeof(node_t *);
+            children = n->list.items;
+            n_children = n->list.n_items;
+            break;
+        case NODE_REDIRECT:
+            if (n->redirect.mode > 0)
+                *bytes += strlen(n->redirect.target) + 1;
+            more[n_children++] = n->redirect.child;
+            break;
+        case NODE_SUBSHELL:
+            more[n_children++] = n->subshell.child;
+            break;
+        case NODE_DETACH:
+            more[n_children++] = n->detach.child;
+            break;
+        case NODE_SEQUENCE:
+            more[n_children++] = n->sequence.first;
+            more[n_children++] = n->sequence.second;
+            break;
+        }
+
+        if (depth + n_children > cap) {
+            cap = 2 * (depth + n_children);
+            stack = realloc(stack, cap * sizeof(node_t *));
+            if (stack == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (i = 0; i < n_children; ++i)
+            if (children[i])
+                stack[depth++] = children[i];
+        n = depth > 0 ? stack[--depth] : NULL;
+    }
+    free(stack);
 }
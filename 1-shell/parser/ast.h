@@ -10,9 +10,13 @@ enum node_type
     NODE_REDIRECT,
     NODE_SUBSHELL,
     NODE_SEQUENCE,
-    NODE_DETACH
+    NODE_DETACH,
+    NODE_LIST // flattened sequence, only built by optimize_tree()
 };
 
+// Node flags, set by optimize_tree()
+#define NODE_SPAWN_ONLY 0x1 // no built-ins anywhere below this node
+
 enum redirect_type
 {
     REDIRECT_DUP = 0, // >&
@@ -27,6 +31,7 @@ typedef struct tree_node node_t;
 struct tree_node
 {
     enum node_type type;
+    unsigned flags;
 
     union {
         struct {
@@ -62,9 +67,30 @@ struct tree_node
             node_t *first;
             node_t *second;
         } sequence;
+
+        struct {
+            node_t **items; // array
+            size_t n_items;
+        } list;
     };
 };
 
+/*
+ * Node counters, kept by the node constructors and free_tree().
+ */
+struct ast_stats {
+    size_t nodes_made; // all nodes ever built
+    size_t nodes_live; // nodes built and not freed yet
+};
+
+extern struct ast_stats ast_stats;
+
+/*
+ * Count the nodes of a command tree and the heap bytes it takes up
+ * (nodes, arrays and strings).
+ */
+void tree_stats(node_t *root, size_t *nodes, size_t *bytes);
+
 /*
  * This function de-allocates a command tree.
  */
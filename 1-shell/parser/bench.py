@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Compare the parse speed of 42sh built with different lemon table options.
+
+For every set of lemon options (by default none, i.e. the classic layout, and
+-z) a copy of the shell is built with parser.c generated using those options.
+The script prints the size of the parse tables as reported by `lemon -s` and
+the rate at which `42sh -n -p` parses a generated script: the lines are read
+with getline(3) rather than readline, and nothing is run, so the time goes to
+the lexer and the parser. Every run is repeated and the best is kept.
+
+Usage: parser/bench.py [--lines N] [--repeat N] [-- OPTIONS...]
+where each OPTIONS is one argument of lemon flags, such as "-z" or "-c -r",
+and "" stands for no flags.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+SHELL_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# One line per pattern; every construct of the grammar is used, with some
+# nesting, so that most parser states are visited.
+CORPUS_LINES = [
+    "ls -l /tmp%d | grep -v x | wc -l; cd /; { pwd; echo %d; } | tac",
+    ">out%d echo \"quoted %d\"; <out%d >>all 2>err cat & 2>&1 &>log ls",
+    "( cd /usr; { ls; ( pwd | cat ) ; } | sort -r ) ; echo %d %d",
+    "a%d b c d e f g h i j k l m n o p q r s t u v w x y z %d",
+]
+
+
+def write_corpus(path, lines):
+    with open(path, "w") as f:
+        for i in range(lines):
+            pattern = CORPUS_LINES[i % len(CORPUS_LINES)]
+            f.write(pattern % ((i,) * pattern.count("%d")) + "\n")
+
+
+def build(flags, tmpdir):
+    """Build 42sh with parser.c generated by `lemon -s FLAGS` in a copy of the
+    tree, and return the path of the binary and lemon's statistics."""
+    tree = os.path.join(tmpdir, "tree")
+    shutil.rmtree(tree, ignore_errors=True)
+    shutil.copytree(SHELL_DIR, tree, ignore=shutil.ignore_patterns(
+        "*.o", "42sh", "parser.c", "parser.h", "lemon"))
+
+    def run(*args):
+        p = subprocess.run(args, cwd=tree, stdout=subprocess.PIPE,
+                           stderr=subprocess.STDOUT, universal_newlines=True)
+        if p.returncode:
+            sys.exit("%s failed:\n%s" % (" ".join(args), p.stdout))
+        return p.stdout
+
+    run("make", "parser/lemon")
+    stats = run("parser/lemon", "-s", "-q", *flags.split(), "parser/parser.y")
+    run("make")
+    entries = re.search(r"(\d+) parser table entries", stats)
+    size = re.search(r"(\d+) bytes of parse tables", stats)
+    return (os.path.join(tree, "42sh"),
+            int(entries.group(1)) if entries else 0,
+            int(size.group(1)) if size else 0)
+
+
+def parse_rate(shell, corpus, lines, repeat):
+    best = 0.0
+    for _ in range(repeat):
+        start = time.perf_counter()
+        with open(os.devnull, "w") as devnull:
+            p = subprocess.run([shell, "-n", "-p", corpus],
+                               stdin=subprocess.DEVNULL, stdout=devnull,
+                               stderr=subprocess.PIPE)
+        elapsed = time.perf_counter() - start
+        if p.returncode or p.stderr:
+            sys.exit("%s -n -p %s failed:\n%s" %
+                     (shell, corpus, p.stderr.decode("UTF-8")))
+        best = max(best, lines / elapsed)
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare parse throughput for lemon table options.")
+    parser.add_argument("--lines", type=int, default=200000,
+                        help="lines in the generated script (default 200000)")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="runs per build (default 5)")
+    parser.add_argument("options", nargs="*", default=["", "-z"],
+                        help="lemon flags per build (default: none, -z)")
+    args = parser.parse_args()
+
+    print("%-12s %8s %8s %14s" % ("lemon flags", "entries", "bytes",
+                                  "lines/s"))
+    with tempfile.TemporaryDirectory(prefix="42sh-parse-bench-") as tmpdir:
+        corpus = os.path.join(tmpdir, "corpus.sh")
+        write_corpus(corpus, args.lines)
+        for flags in args.options:
+            shell, entries, size = build(flags, tmpdir)
+            rate = parse_rate(shell, corpus, args.lines, args.repeat)
+            print("%-12s %8d %8d %14.0f" % (flags or "(none)", entries, size,
+                                            rate))
+
+
+if __name__ == "__main__":
+    main()
@@ -389,6 +389,9 @@ struct lemon {
   int basisflag;           /* Print only basis configurations */
   int has_fallback;        /* True if any %fallback is seen in the grammar */
   int nolinenosflag;       /* True if #line statements should not be printed */
+  int directflag;          /* True to emit switches instead of action tables */
+  int packflag;            /* True to pack the action tables more tightly */
+  int tablebytes;          /* Bytes taken by the parse tables */
   char *argv0;             /* Name of the program */
 };
 
@@ -560,6 +563,8 @@ struct acttab {
   int mxLookahead;             /* Maximum aLookahead[].lookahead */
   int nLookahead;              /* Used slots in aLookahead[] */
   int nLookaheadAlloc;         /* Slots allocated in aLookahead[] */
+  int bestFit;                 /* Look further than the first hole */
+  int nonNegative;             /* Only place sets at offsets >= 0 */
 };
 
 /* Return the number of entries in the yy_action table */
@@ -625,10 +630,16 @@ void acttab_action(acttab *p, int lookahead, int action){
 ** into the current action table.  Then reset the transaction set back
 ** to an empty set in preparation for a new round of acttab_action() calls.
 **
+** If makeItSafe is false, the set may share its offset with entries for
+** other lookaheads.  That is only correct for sets that are never looked
+** up with a lookahead they do not contain, which is the case for the
+** non-terminals of a grammar without an error symbol.
+**
 ** Return the offset into the action table of the new transaction.
 */
-int acttab_insert(acttab *p){
+int acttab_insert(acttab *p, int makeItSafe){
   int i, j, k, n;
+  int iBest, nBest, nBestUsed, nUsed, nEnd;
   assert( p->nLookahead>0 );
 
   /* Make sure we have enough space to hold the expanded action table
@@ -662,6 +673,7 @@ int acttab_insert(acttab *p){
       /* All lookaheads and actions in the aLookahead[] transaction
       ** must match against the candidate aAction[i] entry. */
       if( p->aAction[i].action!=p->mnAction ) continue;
+      if( p->nonNegative && i<p->mnLookahead ) continue;
       for(j=0; j<p->nLookahead; j++){
         k = p->aLookahead[j].lookahead - p->mnLookahead + i;
         if( k<0 || k>=p->nAction ) break;
@@ -677,7 +689,7 @@ int acttab_insert(acttab *p){
         if( p->aAction[j].lookahead<0 ) continue;
         if( p->aAction[j].lookahead==j+p->mnLookahead-i ) n++;
       }
-      if( n==p->nLookahead ){
+      if( n==p->nLookahead || !makeItSafe ){
         break;  /* An exact match is found at offset i */
       }
     }
@@ -691,8 +703,15 @@ int acttab_insert(acttab *p){
     /* Look for holes in the aAction[] table that fit the current
     ** aLookahead[] transaction.  Leave i set to the offset of the hole.
     ** If no holes are found, i is left at p->nAction, which means the
-    ** transaction will be appended. */
-    for(i=0; i<p->nActionAlloc - p->mxLookahead; i++){
+    ** transaction will be appended.
+    **
+    ** With bestFit, keep looking for a hole that grows the table less or,
+    ** failing that, one whose span is more crowded already, so that wide
+    ** holes are left for wide sets. */
+    iBest = -1;
+    nBest = nBestUsed = 0;
+    for(i=p->nonNegative ? p->mnLookahead : 0;
+        i<p->nActionAlloc - p->mxLookahead; i++){
       if( p->aAction[i].lookahead<0 ){
         for(j=0; j<p->nLookahead; j++){
           k = p->aLookahead[j].lookahead - p->mnLookahead + i;
@@ -700,14 +719,29 @@ int acttab_insert(acttab *p){
           if( p->aAction[k].lookahead>=0 ) break;
         }
         if( j<p->nLookahead ) continue;
-        for(j=0; j<p->nAction; j++){
-          if( p->aAction[j].lookahead==j+p->mnLookahead-i ) break;
+        if( makeItSafe ){
+          for(j=0; j<p->nAction; j++){
+            if( p->aAction[j].lookahead==j+p->mnLookahead-i ) break;
+          }
+          if( j<p->nAction ) continue;
         }
-        if( j==p->nAction ){
+        if( !p->bestFit ){
           break;  /* Fits in empty slots */
         }
+        n = p->mxLookahead - p->mnLookahead + i + 1;
+        nEnd = n>p->nAction ? n : p->nAction;
+        for(nUsed=0, k=i; k<n && k<p->nAction; k++){
+          if( p->aAction[k].lookahead>=0 ) nUsed++;
+        }
+        if( iBest<0 || nEnd<nBest || (nEnd==nBest && nUsed>nBestUsed) ){
+          iBest = i;
+          nBest = nEnd;
+          nBestUsed = nUsed;
+        }
+        if( i>=p->nAction ) break;  /* Later offsets only grow more */
       }
     }
+    if( p->bestFit && iBest>=0 ) i = iBest;
   }
   /* Insert transaction set at index i. */
   for(j=0; j<p->nLookahead; j++){
@@ -1492,6 +1526,8 @@ int main(int argc __attribute__((unused)), char **argv)
   static int statistics = 0;
   static int mhflag = 0;
   static int nolinenosflag = 0;
+  static int directflag = 0;
+  static int packflag = 0;
   static int noResort = 0;
   static struct s_options options[] = {
     {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
@@ -1509,7 +1545,10 @@ int main(int argc __attribute__((unused)), char **argv)
     {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
     {OPT_FLAG, "s", (char*)&statistics,
                                    "Print parser stats to standard output."},
+    {OPT_FLAG, "t", (char*)&directflag,
+                    "Direct-code the state transitions instead of tables."},
     {OPT_FLAG, "x", (char*)&version, "Print the version number."},
+    {OPT_FLAG, "z", (char*)&packflag, "Pack the parse tables more tightly."},
     {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
     {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
     {OPT_FLAG,0,0,0}
@@ -1538,6 +1577,8 @@ int main(int argc __attribute__((unused)), char **argv)
   lem.filename = OptArg(0);
   lem.basisflag = basisflag;
   lem.nolinenosflag = nolinenosflag;
+  lem.directflag = directflag;
+  lem.packflag = packflag;
   Symbol_new("$");
   lem.errsym = Symbol_new("error");
   lem.errsym->useCnt = 0;
@@ -1616,6 +1657,7 @@ int main(int argc __attribute__((unused)), char **argv)
       lem.nterminal, lem.nsymbol - lem.nterminal, lem.nrule);
     printf("                   %d states, %d parser table entries, %d conflicts\n",
       lem.nstate, lem.tablesize, lem.nconflict);
+    printf("                   %d bytes of parse tables\n", lem.tablebytes);
   }
   if( lem.nconflict > 0 ){
     fprintf(stderr,"%d parsing conflicts.\n",lem.nconflict);
@@ -3678,6 +3720,7 @@ struct axset {
   struct state *stp;   /* A pointer to a state */
   int isTkn;           /* True to use tokens.  False for non-terminals */
   int nAction;         /* Number of actions */
+  int nWidth;          /* Largest minus smallest lookahead, plus one */
   int iOrder;          /* Original order of action sets */
 };
 
@@ -3696,6 +3739,164 @@ static int axset_compare(const void *a, const void *b){
   return c;
 }
 
+/*
+** Like axset_compare(), but order the widest sets first
+*/
+static int axset_width_compare(const void *a, const void *b){
+  struct axset *p1 = (struct axset*)a;
+  struct axset *p2 = (struct axset*)b;
+  int c;
+  c = p2->nWidth - p1->nWidth;
+  if( c==0 ){
+    c = axset_compare(a, b);
+  }
+  return c;
+}
+
+/*
+** Ways of building the yy_action[] table, combined in the iStrategy
+** argument of build_acttab().  Zero gives the classic table.
+*/
+#define PACK_BY_WIDTH    0x01  /* Place the widest sets first */
+#define PACK_BEST_FIT    0x02  /* See acttab.bestFit */
+#define PACK_NONNEGATIVE 0x04  /* See acttab.nonNegative */
+#define PACK_LOOSE_GOTO  0x08  /* Let goto sets share offsets */
+#define PACK_NSTRATEGY   0x10
+
+/*
+** Build the yy_action[] table and record the offset of each state.
+*/
+static acttab *build_acttab(struct lemon *lemp, int iStrategy){
+  struct axset *ax;
+  struct state *stp;
+  struct action *ap;
+  acttab *pActtab;
+  int i, action, mn, mx;
+
+  /* Compute the actions on all states and count them up */
+  ax = (struct axset *) calloc(lemp->nstate*2, sizeof(ax[0]));
+  if( ax==0 ){
+    fprintf(stderr,"malloc failed\n");
+    exit(1);
+  }
+  for(i=0; i<lemp->nstate*2; i++){
+    stp = lemp->sorted[i/2];
+    ax[i].stp = stp;
+    ax[i].isTkn = i%2==0;
+    ax[i].nAction = ax[i].isTkn ? stp->nTknAct : stp->nNtAct;
+    ax[i].iOrder = i;
+    mn = lemp->nsymbol;
+    mx = -1;
+    for(ap=stp->ap; ap; ap=ap->next){
+      if( (ap->sp->index<lemp->nterminal)!=ax[i].isTkn ) continue;
+      if( ap->sp->index==lemp->nsymbol ) continue;
+      if( compute_action(lemp, ap)<0 ) continue;
+      if( ap->sp->index<mn ) mn = ap->sp->index;
+      if( ap->sp->index>mx ) mx = ap->sp->index;
+    }
+    ax[i].nWidth = mx<mn ? 0 : mx - mn + 1;
+  }
+
+  /* Compute the action table.  In order to try to keep the size of the
+  ** action table to a minimum, the heuristic of placing the largest action
+  ** sets first is used.
+  */
+  qsort(ax, lemp->nstate*2, sizeof(ax[0]),
+        iStrategy & PACK_BY_WIDTH ? axset_width_compare : axset_compare);
+  pActtab = acttab_alloc();
+  pActtab->bestFit = (iStrategy & PACK_BEST_FIT)!=0;
+  pActtab->nonNegative = (iStrategy & PACK_NONNEGATIVE)!=0;
+  for(i=0; i<lemp->nstate*2; i++){
+    if( ax[i].nAction==0 ) continue;
+    stp = ax[i].stp;
+    if( ax[i].isTkn ){
+      for(ap=stp->ap; ap; ap=ap->next){
+        if( ap->sp->index>=lemp->nterminal ) continue;
+        action = compute_action(lemp, ap);
+        if( action<0 ) continue;
+        acttab_action(pActtab, ap->sp->index, action);
+      }
+      stp->iTknOfst = acttab_insert(pActtab, 1);
+    }else{
+      for(ap=stp->ap; ap; ap=ap->next){
+        if( ap->sp->index<lemp->nterminal ) continue;
+        if( ap->sp->index==lemp->nsymbol ) continue;
+        action = compute_action(lemp, ap);
+        if( action<0 ) continue;
+        acttab_action(pActtab, ap->sp->index, action);
+      }
+      /* Gotos are only looked up for non-terminals the state has, unless
+      ** error recovery pops states without knowing that */
+      stp->iNtOfst = acttab_insert(pActtab,
+          (iStrategy & PACK_LOOSE_GOTO)==0 || lemp->errsym->useCnt);
+    }
+  }
+  free(ax);
+  return pActtab;
+}
+
+/*
+** The number of bytes taken by a type returned by minimum_size_type()
+*/
+static int type_size(const char *zType){
+  if( strstr(zType, "char") ) return 1;
+  if( strstr(zType, "short") ) return 2;
+  return 4;
+}
+
+/*
+** Find the range of the yy_shift_ofst[] (if isTkn) or yy_reduce_ofst[]
+** entries, the value that marks states without actions and the number
+** of entries.  The marker goes below the offsets, or above them if they
+** are not negative and the tables are packed, which keeps the array
+** unsigned.
+*/
+static void offset_range(
+  struct lemon *lemp,
+  int isTkn,
+  int *pMn, int *pMx,    /* Write the smallest and largest offset here */
+  int *pDflt,            /* Write the marker here */
+  int *pCount            /* Write the number of entries here */
+){
+  struct state *stp;
+  int i, ofst;
+
+  *pMn = *pMx = 0;
+  *pCount = 0;
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    ofst = isTkn ? stp->iTknOfst : stp->iNtOfst;
+    if( ofst==NO_OFFSET ) continue;
+    if( ofst<*pMn ) *pMn = ofst;
+    if( ofst>*pMx ) *pMx = ofst;
+    *pCount = i+1;
+  }
+  *pDflt = lemp->packflag && *pMn>=0 ? *pMx + 1 : *pMn - 1;
+}
+
+/* The type for offsets from mn to mx, and the marker dflt */
+static const char *offset_type(int mn, int mx, int dflt){
+  return minimum_size_type(dflt<mn ? dflt : mn, dflt>mx ? dflt : mx);
+}
+
+/*
+** The number of bytes the yy_action[], yy_lookahead[], yy_shift_ofst[]
+** and yy_reduce_ofst[] arrays take for the table last built
+*/
+static int table_bytes(struct lemon *lemp, acttab *pActtab){
+  int mn, mx, dflt, n, isTkn;
+  int nByte;
+
+  nByte = acttab_size(pActtab)*(
+            type_size(minimum_size_type(0, lemp->nstate+lemp->nrule+5)) +
+            type_size(minimum_size_type(0, lemp->nsymbol+1)));
+  for(isTkn=0; isTkn<2; isTkn++){
+    offset_range(lemp, isTkn, &mn, &mx, &dflt, &n);
+    nByte += n*type_size(offset_type(mn, mx, dflt));
+  }
+  return nByte;
+}
+
 /*
 ** Write text on "out" that describes the rule "rp".
 */
@@ -3717,6 +3918,55 @@ static void writeRuleText(FILE *out, struct rule *rp){
 }
 
 
+/*
+** Generate yy_direct_shift() (if isTkn) or yy_direct_reduce(): the actions
+** that would go into yy_action[] for terminals or non-terminals, coded as
+** one switch per state.  The C compiler turns these into jump tables, so a
+** lookup needs none of the offset and collision checks of the packed table.
+** The function returns -1 where the state has no action for the symbol,
+** in which case the template uses yy_default[].
+*/
+PRIVATE void emit_direct_lookup(
+  FILE *out,
+  struct lemon *lemp,
+  int isTkn,
+  int *lineno
+){
+  struct state *stp;
+  struct action *ap;
+  int i, nCase, iLast, action;
+
+  fprintf(out, "static int yy_direct_%s(int stateno, YYCODETYPE iLookAhead){\n",
+          isTkn ? "shift" : "reduce"); (*lineno)++;
+  fprintf(out, "  switch( stateno ){\n"); (*lineno)++;
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    nCase = 0;
+    iLast = -1;
+    for(ap=stp->ap; ap; ap=ap->next){
+      if( isTkn ){
+        if( ap->sp->index>=lemp->nterminal ) continue;
+      }else{
+        if( ap->sp->index<lemp->nterminal ) continue;
+        if( ap->sp->index==lemp->nsymbol ) continue;
+      }
+      action = compute_action(lemp, ap);
+      if( action<0 || ap->sp->index==iLast ) continue;
+      if( nCase++==0 ){
+        fprintf(out, "    case %d:\n", stp->statenum); (*lineno)++;
+        fprintf(out, "      switch( iLookAhead ){\n"); (*lineno)++;
+      }
+      fprintf(out, "        case %d: return %d;  /* %s */\n",
+              ap->sp->index, action, ap->sp->name); (*lineno)++;
+      iLast = ap->sp->index;
+    }
+    if( nCase>0 ){
+      fprintf(out, "      }\n      break;\n"); (*lineno) += 2;
+    }
+  }
+  fprintf(out, "  }\n  return -1;\n}\n"); (*lineno) += 3;
+}
+
 /* Generate C source code for the parser */
 void ReportTable(
   struct lemon *lemp,
@@ -3726,14 +3976,15 @@ void ReportTable(
   char line[LINESIZE];
   int  lineno;
   struct state *stp;
-  struct action *ap;
   struct rule *rp;
   struct acttab *pActtab;
   int i, j, n;
   const char *name;
   int mnTknOfst, mxTknOfst;
   int mnNtOfst, mxNtOfst;
-  struct axset *ax;
+  int dfltTknOfst, dfltNtOfst;
+  int nTknOfst, nNtOfst;
+  int iStrategy, nBest;
 
   in = tplt_open(lemp);
   if( in==0 ) return;
@@ -3833,143 +4084,120 @@ void ReportTable(
   **  yy_default[]       Default action for each state.
   */
 
-  /* Compute the actions on all states and count them up */
-  ax = (struct axset *) calloc(lemp->nstate*2, sizeof(ax[0]));
-  if( ax==0 ){
-    fprintf(stderr,"malloc failed\n");
-    exit(1);
-  }
-  for(i=0; i<lemp->nstate; i++){
-    stp = lemp->sorted[i];
-    ax[i*2].stp = stp;
-    ax[i*2].isTkn = 1;
-    ax[i*2].nAction = stp->nTknAct;
-    ax[i*2+1].stp = stp;
-    ax[i*2+1].isTkn = 0;
-    ax[i*2+1].nAction = stp->nNtAct;
-  }
-  mxTknOfst = mnTknOfst = 0;
-  mxNtOfst = mnNtOfst = 0;
-
-  /* Compute the action table.  In order to try to keep the size of the
-  ** action table to a minimum, the heuristic of placing the largest action
-  ** sets first is used.
-  */
-  for(i=0; i<lemp->nstate*2; i++) ax[i].iOrder = i;
-  qsort(ax, lemp->nstate*2, sizeof(ax[0]), axset_compare);
-  pActtab = acttab_alloc();
-  for(i=0; i<lemp->nstate*2 && ax[i].nAction>0; i++){
-    stp = ax[i].stp;
-    if( ax[i].isTkn ){
-      for(ap=stp->ap; ap; ap=ap->next){
-        int action;
-        if( ap->sp->index>=lemp->nterminal ) continue;
-        action = compute_action(lemp, ap);
-        if( action<0 ) continue;
-        acttab_action(pActtab, ap->sp->index, action);
+  /* Compute the action table.  With -z, every combination of the ways
+  ** to build it is tried, and the one giving the smallest arrays kept. */
+  iStrategy = 0;
+  if( lemp->packflag ){
+    nBest = -1;
+    for(i=0; i<PACK_NSTRATEGY; i++){
+      if( (i & PACK_LOOSE_GOTO) && lemp->errsym->useCnt ) continue;
+      pActtab = build_acttab(lemp, i);
+      n = table_bytes(lemp, pActtab);
+      acttab_free(pActtab);
+      if( nBest<0 || n<nBest ){
+        nBest = n;
+        iStrategy = i;
       }
-      stp->iTknOfst = acttab_insert(pActtab);
-      if( stp->iTknOfst<mnTknOfst ) mnTknOfst = stp->iTknOfst;
-      if( stp->iTknOfst>mxTknOfst ) mxTknOfst = stp->iTknOfst;
-    }else{
-      for(ap=stp->ap; ap; ap=ap->next){
-        int action;
-        if( ap->sp->index<lemp->nterminal ) continue;
-        if( ap->sp->index==lemp->nsymbol ) continue;
-        action = compute_action(lemp, ap);
-        if( action<0 ) continue;
-        acttab_action(pActtab, ap->sp->index, action);
-      }
-      stp->iNtOfst = acttab_insert(pActtab);
-      if( stp->iNtOfst<mnNtOfst ) mnNtOfst = stp->iNtOfst;
-      if( stp->iNtOfst>mxNtOfst ) mxNtOfst = stp->iNtOfst;
     }
   }
-  free(ax);
-
-  /* Output the yy_action table */
-  n = acttab_size(pActtab);
-  fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
-  fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
-  for(i=j=0; i<n; i++){
-    int action = acttab_yyaction(pActtab, i);
-    if( action<0 ) action = lemp->nstate + lemp->nrule + 2;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", action);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+  pActtab = build_acttab(lemp, iStrategy);
+  offset_range(lemp, 1, &mnTknOfst, &mxTknOfst, &dfltTknOfst, &nTknOfst);
+  offset_range(lemp, 0, &mnNtOfst, &mxNtOfst, &dfltNtOfst, &nNtOfst);
+  lemp->tablesize = acttab_size(pActtab);
+  lemp->tablebytes = lemp->nstate*
+                     type_size(minimum_size_type(0, lemp->nstate+lemp->nrule+5));
+  if( !lemp->directflag ){
+    lemp->tablebytes += table_bytes(lemp, pActtab);
+  }
+
+  if( lemp->directflag ){
+    /* Output yy_direct_shift() and yy_direct_reduce() */
+    fprintf(out, "#define YY_DIRECT_CODED 1\n"); lineno++;
+    emit_direct_lookup(out, lemp, 1, &lineno);
+    emit_direct_lookup(out, lemp, 0, &lineno);
+  }else{
+    /* Output the yy_action table */
+    n = acttab_size(pActtab);
+    fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
+    fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
+    for(i=j=0; i<n; i++){
+      int action = acttab_yyaction(pActtab, i);
+      if( action<0 ) action = lemp->nstate + lemp->nrule + 2;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", action);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
     }
-  }
-  fprintf(out, "};\n"); lineno++;
-
-  /* Output the yy_lookahead table */
-  fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
-  for(i=j=0; i<n; i++){
-    int la = acttab_yylookahead(pActtab, i);
-    if( la<0 ) la = lemp->nsymbol;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", la);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_lookahead table */
+    fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
+    for(i=j=0; i<n; i++){
+      int la = acttab_yylookahead(pActtab, i);
+      if( la<0 ) la = lemp->nsymbol;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", la);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
     }
-  }
-  fprintf(out, "};\n"); lineno++;
-
-  /* Output the yy_shift_ofst[] table */
-  fprintf(out, "#define YY_SHIFT_USE_DFLT (%d)\n", mnTknOfst-1); lineno++;
-  n = lemp->nstate;
-  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_SHIFT_COUNT (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_SHIFT_MIN   (%d)\n", mnTknOfst); lineno++;
-  fprintf(out, "#define YY_SHIFT_MAX   (%d)\n", mxTknOfst); lineno++;
-  fprintf(out, "static const %s yy_shift_ofst[] = {\n",
-          minimum_size_type(mnTknOfst-1, mxTknOfst)); lineno++;
-  for(i=j=0; i<n; i++){
-    int ofst;
-    stp = lemp->sorted[i];
-    ofst = stp->iTknOfst;
-    if( ofst==NO_OFFSET ) ofst = mnTknOfst - 1;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_shift_ofst[] table */
+    fprintf(out, "#define YY_SHIFT_USE_DFLT (%d)\n", dfltTknOfst); lineno++;
+    n = nTknOfst;
+    fprintf(out, "#define YY_SHIFT_COUNT (%d)\n", n-1); lineno++;
+    fprintf(out, "#define YY_SHIFT_MIN   (%d)\n", mnTknOfst); lineno++;
+    fprintf(out, "#define YY_SHIFT_MAX   (%d)\n", mxTknOfst); lineno++;
+    fprintf(out, "static const %s yy_shift_ofst[] = {\n",
+            offset_type(mnTknOfst, mxTknOfst, dfltTknOfst)); lineno++;
+    for(i=j=0; i<n; i++){
+      int ofst;
+      stp = lemp->sorted[i];
+      ofst = stp->iTknOfst;
+      if( ofst==NO_OFFSET ) ofst = dfltTknOfst;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", ofst);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
     }
-  }
-  fprintf(out, "};\n"); lineno++;
-
-  /* Output the yy_reduce_ofst[] table */
-  fprintf(out, "#define YY_REDUCE_USE_DFLT (%d)\n", mnNtOfst-1); lineno++;
-  n = lemp->nstate;
-  while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
-  fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
-  fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
-          minimum_size_type(mnNtOfst-1, mxNtOfst)); lineno++;
-  for(i=j=0; i<n; i++){
-    int ofst;
-    stp = lemp->sorted[i];
-    ofst = stp->iNtOfst;
-    if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_reduce_ofst[] table */
+    fprintf(out, "#define YY_REDUCE_USE_DFLT (%d)\n", dfltNtOfst); lineno++;
+    n = nNtOfst;
+    fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
+    fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
+    fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
+    fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
+            offset_type(mnNtOfst, mxNtOfst, dfltNtOfst)); lineno++;
+    for(i=j=0; i<n; i++){
+      int ofst;
+      stp = lemp->sorted[i];
+      ofst = stp->iNtOfst;
+      if( ofst==NO_OFFSET ) ofst = dfltNtOfst;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", ofst);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
     }
+    fprintf(out, "};\n"); lineno++;
   }
-  fprintf(out, "};\n"); lineno++;
 
   /* Output the default action table */
   fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
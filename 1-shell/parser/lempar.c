@@ -4,6 +4,8 @@
 /* First off, code is included that follows the "include" declaration
 ** in the input grammar file. */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 %%
 /* Next is all token values, in a form suitable for use by makeheaders.
 ** This section will be null unless lemon is run with the -m switch.
@@ -44,8 +46,9 @@
 **                       This is typically a union of many types, one of
 **                       which is ParseTOKENTYPE.  The entry in the union
 **                       for base tokens is called "yy0".
-**    YYSTACKDEPTH       is the maximum depth of the parser's stack.  If
-**                       zero the stack is dynamically sized using realloc()
+**    YYSTACKDEPTH       is the depth of the stack kept inside the parser
+**                       object.  Deeper stacks are allocated when needed.
+**                       If zero, the stack is always allocated.
 **    ParseARG_SDECL     A static variable declaration for the %extra_argument
 **    ParseARG_PDECL     A parameter declaration for the %extra_argument
 **    ParseARG_STORE     Code to store %extra_argument into yypParser
@@ -123,6 +126,11 @@ static const YYMINORTYPE yyzerominor = { 0 };
 **  yy_reduce_ofst[]   For each state, the offset into yy_action for
 **                     shifting non-terminals after a reduce.
 **  yy_default[]       Default action for each state.
+**
+** When lemon is run with -t, the first four are replaced by the functions
+** yy_direct_shift() and yy_direct_reduce(), which hold the same actions as
+** a switch per state and return -1 where yy_default[] applies.  This is
+** flagged by YY_DIRECT_CODED.
 */
 %%
 
@@ -172,11 +180,10 @@ struct yyParser {
 #endif
   int yyerrcnt;                 /* Shifts left before out of the error */
   ParseARG_SDECL                /* A place to hold %extra_argument */
-#if YYSTACKDEPTH<=0
-  int yystksz;                  /* Current side of the stack */
+  int yystksz;                  /* Current size of the stack */
   yyStackEntry *yystack;        /* The parser's stack */
-#else
-  yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
+#if YYSTACKDEPTH>0
+  yyStackEntry yystk0[YYSTACKDEPTH];  /* Initial stack, part of the parser */
 #endif
 };
 typedef struct yyParser yyParser;
@@ -230,16 +237,56 @@ static const char *const yyRuleName[] = {
 #endif /* NDEBUG */
 
 
-#if YYSTACKDEPTH<=0
+/* True if the stack of p was allocated rather than part of p */
+#if YYSTACKDEPTH>0
+# define yyStackIsAllocated(p) ((p)->yystack!=(p)->yystk0)
+#else
+# define yyStackIsAllocated(p) ((p)->yystack!=0)
+#endif
+
+/* Make the pool below per thread where the compiler allows it, as every
+** thread runs its own parsers */
+#ifndef YYTHREADLOCAL
+# if defined(__STDC_VERSION__) && __STDC_VERSION__>=201112L \
+     && !defined(__STDC_NO_THREADS__)
+#  define YYTHREADLOCAL _Thread_local
+# else
+#  define YYTHREADLOCAL
+# endif
+#endif
+
+/* The largest allocated stack of the parsers freed so far.  The next
+** parser that needs to grow its stack takes it over, so that input that
+** nests deeply does not allocate a new stack for every parser. */
+static YYTHREADLOCAL yyStackEntry *yyStackPool = 0;
+static YYTHREADLOCAL int yyStackPoolSz = 0;
+
 /*
-** Try to increase the size of the parser stack.
+** Try to increase the size of the parser stack.  The stack at least
+** doubles, and the entries in use are kept.
 */
 static void yyGrowStack(yyParser *p){
   int newSize;
   yyStackEntry *pNew;
 
   newSize = p->yystksz*2 + 100;
-  pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
+  if( yyStackPool && yyStackPoolSz>=newSize ){
+    pNew = yyStackPool;
+    newSize = yyStackPoolSz;
+    yyStackPool = 0;
+    yyStackPoolSz = 0;
+    if( p->yyidx>=0 ){
+      memcpy(pNew, p->yystack, p->yyidx*sizeof(pNew[0]));
+    }
+    if( yyStackIsAllocated(p) ) free(p->yystack);
+  }else if( yyStackIsAllocated(p) ){
+    pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
+  }else{
+    pNew = malloc(newSize*sizeof(pNew[0]));
+    if( pNew && p->yyidx>=0 ){
+      memcpy(pNew, p->yystack, p->yyidx*sizeof(pNew[0]));
+    }
+  }
   if( pNew ){
     p->yystack = pNew;
     p->yystksz = newSize;
@@ -251,7 +298,6 @@ static void yyGrowStack(yyParser *p){
 #endif
   }
 }
-#endif
 
 /* 
 ** This function allocates a new parser.
@@ -277,6 +323,9 @@ void *ParseAlloc(void *(*mallocProc)(size_t)){
     pParser->yystack = NULL;
     pParser->yystksz = 0;
     yyGrowStack(pParser);
+#else
+    pParser->yystack = pParser->yystk0;
+    pParser->yystksz = YYSTACKDEPTH;
 #endif
   }
   return pParser;
@@ -354,9 +403,15 @@ void ParseFree(
   yyParser *pParser = (yyParser*)p;
   if( pParser==0 ) return;
   while( pParser->yyidx>=0 ) yy_pop_parser_stack(pParser);
-#if YYSTACKDEPTH<=0
-  free(pParser->yystack);
-#endif
+  if( yyStackIsAllocated(pParser) ){
+    if( pParser->yystksz>yyStackPoolSz ){
+      free(yyStackPool);
+      yyStackPool = pParser->yystack;
+      yyStackPoolSz = pParser->yystksz;
+    }else{
+      free(pParser->yystack);
+    }
+  }
   (*freeProc)((void*)pParser);
 }
 
@@ -385,54 +440,65 @@ static int yy_find_shift_action(
   int i;
   int stateno = pParser->yystack[pParser->yyidx].stateno;
  
+#ifdef YY_DIRECT_CODED
+  if( (i = yy_direct_shift(stateno, iLookAhead))>=0 ){
+    return i;
+  }
+#else
   if( stateno>YY_SHIFT_COUNT
    || (i = yy_shift_ofst[stateno])==YY_SHIFT_USE_DFLT ){
     return yy_default[stateno];
   }
   assert( iLookAhead!=YYNOCODE );
   i += iLookAhead;
-  if( i<0 || i>=YY_ACTTAB_COUNT || yy_lookahead[i]!=iLookAhead ){
-    if( iLookAhead>0 ){
+  if( i>=0 && i<YY_ACTTAB_COUNT && yy_lookahead[i]==iLookAhead ){
+    return yy_action[i];
+  }
+#endif
+  if( iLookAhead>0 ){
 #ifdef YYFALLBACK
-      YYCODETYPE iFallback;            /* Fallback token */
-      if( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0])
-             && (iFallback = yyFallback[iLookAhead])!=0 ){
+    YYCODETYPE iFallback;            /* Fallback token */
+    if( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0])
+           && (iFallback = yyFallback[iLookAhead])!=0 ){
 #ifndef NDEBUG
-        if( yyTraceFILE ){
-          fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
-             yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
-        }
-#endif
-        return yy_find_shift_action(pParser, iFallback);
+      if( yyTraceFILE ){
+        fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
+           yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
       }
+#endif
+      return yy_find_shift_action(pParser, iFallback);
+    }
 #endif
 #ifdef YYWILDCARD
-      {
-        int j = i - iLookAhead + YYWILDCARD;
-        if( 
+    {
+#ifdef YY_DIRECT_CODED
+      int j = yy_direct_shift(stateno, YYWILDCARD);
+      if( j>=0 ){
+#else
+      int j = i - iLookAhead + YYWILDCARD;
+      if( 
 #if YY_SHIFT_MIN+YYWILDCARD<0
-          j>=0 &&
+        j>=0 &&
 #endif
 #if YY_SHIFT_MAX+YYWILDCARD>=YY_ACTTAB_COUNT
-          j<YY_ACTTAB_COUNT &&
+        j<YY_ACTTAB_COUNT &&
+#endif
+        yy_lookahead[j]==YYWILDCARD
+      ){
+        j = yy_action[j];
 #endif
-          yy_lookahead[j]==YYWILDCARD
-        ){
 #ifndef NDEBUG
-          if( yyTraceFILE ){
-            fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
-               yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[YYWILDCARD]);
-          }
-#endif /* NDEBUG */
-          return yy_action[j];
+        if( yyTraceFILE ){
+          fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
+             yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[YYWILDCARD]);
         }
+#endif /* NDEBUG */
+        return j;
       }
-#endif /* YYWILDCARD */
     }
-    return yy_default[stateno];
-  }else{
-    return yy_action[i];
+#endif /* YYWILDCARD */
   }
+  return yy_default[stateno];
 }
 
 /*
@@ -448,6 +514,18 @@ static int yy_find_reduce_action(
   YYCODETYPE iLookAhead     /* The look-ahead token */
 ){
   int i;
+#ifdef YY_DIRECT_CODED
+  assert( iLookAhead!=YYNOCODE );
+  i = yy_direct_reduce(stateno, iLookAhead);
+#ifdef YYERRORSYMBOL
+  if( i<0 ){
+    return yy_default[stateno];
+  }
+#else
+  assert( i>=0 );
+#endif
+  return i;
+#else
 #ifdef YYERRORSYMBOL
   if( stateno>YY_REDUCE_COUNT ){
     return yy_default[stateno];
@@ -468,6 +546,7 @@ static int yy_find_reduce_action(
   assert( yy_lookahead[i]==iLookAhead );
 #endif
   return yy_action[i];
+#endif /* YY_DIRECT_CODED */
 }
 
 /*
@@ -504,12 +583,6 @@ static void yy_shift(
     yypParser->yyidxMax = yypParser->yyidx;
   }
 #endif
-#if YYSTACKDEPTH>0 
-  if( yypParser->yyidx>=YYSTACKDEPTH ){
-    yyStackOverflow(yypParser, yypMinor);
-    return;
-  }
-#else
   if( yypParser->yyidx>=yypParser->yystksz ){
     yyGrowStack(yypParser);
     if( yypParser->yyidx>=yypParser->yystksz ){
@@ -517,7 +590,6 @@ static void yy_shift(
       return;
     }
   }
-#endif
   yytos = &yypParser->yystack[yypParser->yyidx];
   yytos->stateno = (YYACTIONTYPE)yyNewState;
   yytos->major = (YYCODETYPE)yyMajor;
@@ -9,6 +9,10 @@ struct lex_token {
 };
 extern char *token_text;
 
+// Size of the buffer the lexer collects words in, and the most of it that
+// any word has needed.
+extern size_t string_buf_len, string_buf_peak;
+
 void *ParseAlloc(void * (*)(size_t));
 void ParseFree(void *, void (*)(void *));
 void Parse(void *, int, struct lex_token);
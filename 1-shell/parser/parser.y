@@ -4,13 +4,15 @@
 %default_destructor { free_tree($$); }
 %type commands { int }
 
-%syntax_error { fprintf(stderr, "mysh: syntax error\n"); parse_error = 1; }
+%syntax_error { syntax_error(); }
+%stack_overflow { syntax_error(); }
 
 %left SEMI.
 %left PIPE.
 
 %include {
 #include "../shell.h"
+#include "../front.h"
 #include "ast.h"
 #include "lexer.h"
 #include <assert.h>
@@ -22,10 +24,7 @@ int parse_error = 0;
 
 top ::= END. { }
 top ::= seq(A) END. { if (parse_error) free_tree(A);
-                      else { if (echo) print_tree_flat(A, 1);
-                             run_command(A);
-                             free_tree(A);
-                           } }
+                      else dispatch_command(A); }
 
 seq(C) ::= pipe(A).             { C = A; }
 seq(C) ::= pipe(A) SEMI.        { C = A; }
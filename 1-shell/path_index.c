@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+#include "path_index.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <readline/readline.h>
+
+// Used by execvp when $PATH is not set.
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+struct path_dir {
+	char *name;
+	int wd;             // inotify watch, or -1 if not watched
+	struct timespec mtime; // When not watched: mtime when last checked.
+	int stale;          // The listing must be read again.
+	char **cmds;        // Sorted executable names.
+	size_t n_cmds;
+};
+
+// Cached result of a lookup.
+struct hit {
+	char *name; // NULL marks an empty slot.
+	char *path;
+};
+
+static char *path_copy = NULL;
+static struct path_dir *dirs = NULL;
+static size_t n_dirs = 0;
+static int notify_fd = -1;
+static int watch = 0; // Use inotify.
+// Set once the modification times have been checked for this command line.
+static int mtimes_checked = 0;
+
+// All directories merged: sorted, without duplicates.
+static char **names = NULL;
+static size_t n_names = 0;
+static int names_stale = 1;
+
+static struct hit *hits = NULL;
+static size_t hits_cap = 0, hits_used = 0;
+
+static void *xrealloc(void *pt, size_t size)
+{
+	pt = realloc(pt, size);
+	if (pt == NULL) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+	return pt;
+}
+
+static char *xstrdup(const char *s)
+{
+	size_t len = strlen(s) + 1;
+
+	return memcpy(xrealloc(NULL, len), s, len);
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void clear_hits(void)
+{
+	for (size_t i = 0; i < hits_cap; i++) {
+		if (hits[i].name == NULL)
+			continue;
+		free(hits[i].name);
+		free(hits[i].path);
+		hits[i].name = NULL;
+	}
+	hits_used = 0;
+}
+
+static uint32_t hash_name(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static struct hit *find_hit(const char *name)
+{
+	size_t mask = hits_cap - 1, i;
+
+	for (i = hash_name(name) & mask; hits[i].name; i = (i + 1) & mask)
+		if (strcmp(hits[i].name, name) == 0)
+			break;
+	return &hits[i];
+}
+
+static void add_hit(const char *name, char *path)
+{
+	struct hit *h;
+
+	if (2 * (hits_used + 1) > hits_cap) {
+		struct hit *old = hits;
+		size_t old_cap = hits_cap;
+
+		hits_cap = hits_cap ? 2 * hits_cap : 64;
+		hits = calloc(hits_cap, sizeof(*hits));
+		if (hits == NULL) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		for (size_t i = 0; i < old_cap; i++)
+			if (old[i].name)
+				*find_hit(old[i].name) = old[i];
+		free(old);
+	}
+	h = find_hit(name);
+	h->name = xstrdup(name);
+	h->path = path;
+	hits_used++;
+}
+
+static void free_dirs(void)
+{
+	for (size_t i = 0; i < n_dirs; i++) {
+		for (size_t j = 0; j < dirs[i].n_cmds; j++)
+			free(dirs[i].cmds[j]);
+		free(dirs[i].cmds);
+		free(dirs[i].name);
+	}
+	free(dirs);
+	dirs = NULL;
+	n_dirs = 0;
+	free(names);
+	names = NULL;
+	n_names = 0;
+	names_stale = 1;
+	clear_hits();
+#ifdef __linux__
+	if (notify_fd != -1)
+		close(notify_fd); // Drops all watches.
+	notify_fd = -1;
+#endif
+}
+
+// The modification time of a directory, or -1 if it does not exist.
+static struct timespec dir_mtime(const char *name)
+{
+	struct stat st;
+
+	if (stat(name, &st) == -1) {
+		st.st_mtim.tv_sec = -1;
+		st.st_mtim.tv_nsec = 0;
+	}
+	return st.st_mtim;
+}
+
+// Throw everything away if $PATH changed since the last call.
+static void check_path(void)
+{
+	const char *path = getenv("PATH");
+	char *p, *colon;
+
+	if (path == NULL)
+		path = DEFAULT_PATH;
+	if (path_copy && strcmp(path, path_copy) == 0)
+		return;
+
+	free_dirs();
+	free(path_copy);
+	path_copy = xstrdup(path);
+#ifdef __linux__
+	if (watch)
+		notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+	for (p = path_copy;; p = colon + 1) {
+		struct path_dir *d;
+
+		colon = strchrnul(p, ':');
+		dirs = xrealloc(dirs, (n_dirs + 1) * sizeof(*dirs));
+		d = &dirs[n_dirs++];
+		// An empty entry stands for the current directory.
+		d->name = p == colon ? xstrdup(".") : strndup(p, colon - p);
+		if (d->name == NULL) {
+			perror("strndup");
+			exit(EXIT_FAILURE);
+		}
+		d->wd = -1;
+		d->stale = 1;
+		d->cmds = NULL;
+		d->n_cmds = 0;
+		d->mtime = dir_mtime(d->name);
+#ifdef __linux__
+		if (notify_fd != -1 && d->name[0] == '/')
+			d->wd = inotify_add_watch(notify_fd, d->name,
+						  IN_CREATE | IN_DELETE | IN_ATTRIB |
+						  IN_MOVED_FROM | IN_MOVED_TO |
+						  IN_DELETE_SELF | IN_MOVE_SELF);
+#endif
+		if (*colon == '\0')
+			break;
+	}
+}
+
+static void mark_stale(struct path_dir *d)
+{
+	d->stale = 1;
+	names_stale = 1;
+	clear_hits();
+}
+
+// Find out which directories changed since the last call.
+static void check_dirs(void)
+{
+#ifdef __linux__
+	_Alignas(struct inotify_event) char buf[4096];
+	ssize_t len;
+
+	while (notify_fd != -1 && (len = read(notify_fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len;) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+
+			p += sizeof(*ev) + ev->len;
+			// Events were lost (this one has wd -1): any directory
+			// may have changed.
+			if (ev->mask & IN_Q_OVERFLOW) {
+				for (size_t i = 0; i < n_dirs; i++)
+					mark_stale(&dirs[i]);
+				continue;
+			}
+			for (size_t i = 0; i < n_dirs; i++) {
+				if (dirs[i].wd != ev->wd)
+					continue;
+				mark_stale(&dirs[i]);
+				// Gone; fall back to checking the mtime.
+				if (ev->mask & IN_IGNORED)
+					dirs[i].wd = -1;
+			}
+		}
+	}
+#endif
+	if (mtimes_checked)
+		return;
+	mtimes_checked = 1;
+	for (size_t i = 0; i < n_dirs; i++) {
+		struct timespec mtime;
+
+		if (dirs[i].wd != -1)
+			continue;
+		// Relative directories change with the working directory.
+		if (dirs[i].name[0] != '/') {
+			dirs[i].stale = 1;
+			names_stale = 1;
+			continue;
+		}
+		mtime = dir_mtime(dirs[i].name);
+		if (mtime.tv_sec != dirs[i].mtime.tv_sec ||
+		    mtime.tv_nsec != dirs[i].mtime.tv_nsec) {
+			dirs[i].mtime = mtime;
+			mark_stale(&dirs[i]);
+		}
+	}
+}
+
+static void read_dir(struct path_dir *d)
+{
+	DIR *dir;
+	struct dirent *ent;
+	struct stat st;
+	size_t cap = 0;
+
+	for (size_t j = 0; j < d->n_cmds; j++)
+		free(d->cmds[j]);
+	free(d->cmds);
+	d->cmds = NULL;
+	d->n_cmds = 0;
+	d->stale = 0;
+
+	if ((dir = opendir(d->name)) == NULL)
+		return;
+
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.' &&
+		    (ent->d_name[1] == '\0' || strcmp(ent->d_name, "..") == 0))
+			continue;
+		if (fstatat(dirfd(dir), ent->d_name, &st, 0) == -1 ||
+		    !S_ISREG(st.st_mode) || !(st.st_mode & 0111))
+			continue;
+		if (d->n_cmds == cap) {
+			cap = cap ? 2 * cap : 64;
+			d->cmds = xrealloc(d->cmds, cap * sizeof(char *));
+		}
+		d->cmds[d->n_cmds++] = xstrdup(ent->d_name);
+	}
+	closedir(dir);
+	qsort(d->cmds, d->n_cmds, sizeof(char *), &cmp_names);
+}
+
+static void update_names(void)
+{
+	size_t total = 0, n = 0;
+
+	check_path();
+	check_dirs();
+	if (!names_stale)
+		return;
+
+	for (size_t i = 0; i < n_dirs; i++) {
+		if (dirs[i].stale)
+			read_dir(&dirs[i]);
+		total += dirs[i].n_cmds;
+	}
+	names = xrealloc(names, (total + 1) * sizeof(char *));
+	for (size_t i = 0; i < n_dirs; i++)
+		for (size_t j = 0; j < dirs[i].n_cmds; j++)
+			names[n++] = dirs[i].cmds[j];
+	qsort(names, n, sizeof(char *), &cmp_names);
+
+	// Drop duplicates.
+	n_names = 0;
+	for (size_t i = 0; i < n; i++)
+		if (n_names == 0 || strcmp(names[n_names - 1], names[i]) != 0)
+			names[n_names++] = names[i];
+	names_stale = 0;
+}
+
+const char *path_index_lookup(const char *name)
+{
+	struct hit *h;
+	struct stat st;
+
+	if (name[0] == '\0' || strchr(name, '/'))
+		return NULL;
+
+	check_path();
+	check_dirs();
+	if (hits_cap > 0 && (h = find_hit(name))->name)
+		return h->path;
+
+	for (size_t i = 0; i < n_dirs; i++) {
+		char *path;
+
+		// Leave relative directories to execvp; they cannot be cached.
+		if (dirs[i].name[0] != '/')
+			return NULL;
+		if (asprintf(&path, "%s/%s", dirs[i].name, name) == -1) {
+			perror("asprintf");
+			exit(EXIT_FAILURE);
+		}
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+		    access(path, X_OK) == 0) {
+			add_hit(name, path);
+			return path;
+		}
+		free(path);
+	}
+	return NULL;
+}
+
+void path_index_expire(void)
+{
+	mtimes_checked = 0;
+}
+
+static size_t next_name;
+
+static char *complete_command(const char *text, int state)
+{
+	size_t len = strlen(text);
+
+	if (state == 0) {
+		size_t lo = 0, hi;
+
+		update_names();
+		// Find the first name not before `text`.
+		hi = n_names;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (strcmp(names[mid], text) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		next_name = lo;
+	}
+
+	if (next_name < n_names && strncmp(names[next_name], text, len) == 0)
+		return xstrdup(names[next_name++]);
+	return NULL;
+}
+
+static char **complete(const char *text, int start, int end)
+{
+	int i = start;
+
+	(void)end;
+
+	// Only the word in command position names a program.
+	while (i > 0 && (rl_line_buffer[i - 1] == ' ' ||
+			 rl_line_buffer[i - 1] == '\t'))
+		i--;
+	if ((i > 0 && !strchr("|;&({", rl_line_buffer[i - 1])) ||
+	    strchr(text, '/'))
+		return NULL;
+	return rl_completion_matches(text, &complete_command);
+}
+
+void path_index_bind(void)
+{
+	rl_attempted_completion_function = &complete;
+	watch = 1;
+	// Start over with watches on the next lookup.
+	free(path_copy);
+	path_copy = NULL;
+}
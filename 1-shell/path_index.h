@@ -0,0 +1,27 @@
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+// Index of the executables in the $PATH directories, used both to look up
+// commands before they are run and to complete command names. Nothing is
+// read until it is first needed; after that, directories are only read again
+// when they change, which is noticed by their modification time (checked
+// once per command line) or, in an interactive shell, through inotify. A
+// change of $PATH itself throws the whole index away.
+
+// Return the full path of the executable that `execvp` would run for `name`,
+// or NULL if `name` contains a slash or is not found. The result stays valid
+// until the next call.
+const char *path_index_lookup(const char *name);
+
+// Check the modification times of the $PATH directories again on the next
+// lookup. Called before every command line; lookups within one line trust
+// what the index has.
+void path_index_expire(void);
+
+// Complete the first word of a command with the names of executables, and
+// watch the $PATH directories with inotify where available. Setting up and
+// closing the watches takes milliseconds, which only pays off in a
+// long-running interactive shell.
+void path_index_bind(void);
+
+#endif /* PATH_INDEX_H */
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include "pipeline.h"
+#include "shell.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct entry {
+	struct tree_node *n;
+	int error;
+	const char *message;
+};
+
+// The queue of parsed lines between the parse-ahead thread and the executing
+// thread. Everything below is protected by `lock`.
+static struct entry queue[PIPELINE_DEPTH];
+static size_t head, count;
+static int done;
+
+// While `paused` is set the parse-ahead thread does not start reading or
+// parsing a new line. `parsing` is set while it is doing so.
+static int paused, parsing;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t state_changed = PTHREAD_COND_INITIALIZER;
+
+static FILE *input;
+static pipeline_parse_fun parse_line;
+
+static void push(struct tree_node *n, int error, const char *message)
+{
+	pthread_mutex_lock(&lock);
+	while (count == PIPELINE_DEPTH)
+		pthread_cond_wait(&not_full, &lock);
+	queue[(head + count) % PIPELINE_DEPTH] = (struct entry){ n, error, message };
+	count++;
+	pthread_cond_signal(&not_empty);
+	pthread_mutex_unlock(&lock);
+}
+
+// Wait for the next parsed line. Returns 0 once the input is exhausted.
+static int pop(struct entry *e)
+{
+	pthread_mutex_lock(&lock);
+	while (count == 0 && !done)
+		pthread_cond_wait(&not_empty, &lock);
+	if (count == 0) {
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+	*e = queue[head];
+	head = (head + 1) % PIPELINE_DEPTH;
+	count--;
+	pthread_cond_signal(&not_full);
+	pthread_mutex_unlock(&lock);
+	return 1;
+}
+
+// Mark the start or end of the parse-ahead thread touching the input and the
+// (non-reentrant) lexer and parser.
+static void set_parsing(int value)
+{
+	pthread_mutex_lock(&lock);
+	while (value && paused)
+		pthread_cond_wait(&state_changed, &lock);
+	parsing = value;
+	pthread_cond_broadcast(&state_changed);
+	pthread_mutex_unlock(&lock);
+}
+
+static void set_paused(int value)
+{
+	pthread_mutex_lock(&lock);
+	paused = value;
+	while (paused && parsing)
+		pthread_cond_wait(&state_changed, &lock);
+	pthread_cond_broadcast(&state_changed);
+	pthread_mutex_unlock(&lock);
+}
+
+static void *parse_ahead(void *arg)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	(void)arg;
+
+	for (;;) {
+		struct tree_node *n = NULL;
+		const char *message = NULL;
+		int error = 0;
+
+		set_parsing(1);
+		len = getline(&line, &size, input);
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		if (len != -1)
+			error = parse_line(line, &n, &message);
+		set_parsing(0);
+
+		if (len == -1)
+			break;
+		if (n || error || message)
+			push(n, error, message);
+	}
+	free(line);
+
+	pthread_mutex_lock(&lock);
+	done = 1;
+	pthread_cond_signal(&not_empty);
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+void pipeline_run(FILE *f, pipeline_parse_fun parse, pipeline_run_fun run)
+{
+	pthread_t helper;
+	struct entry e;
+
+	input = f;
+	parse_line = parse;
+	if (pthread_create(&helper, NULL, &parse_ahead, NULL) != 0) {
+		perror("pthread_create");
+		exit(EXIT_FAILURE);
+	}
+
+	while (pop(&e)) {
+		// `exit` tears down the lexer state through atexit(3), so the
+		// helper must be idle before such a command runs.
+		if (e.n && shell_may_exit(e.n)) {
+			set_paused(1);
+			run(e.n, e.error, e.message);
+			set_paused(0);
+		} else {
+			run(e.n, e.error, e.message);
+		}
+	}
+
+	pthread_join(helper, NULL);
+}
@@ -0,0 +1,30 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <stdio.h>
+
+struct tree_node;
+
+// Maximum number of parsed commands the parse-ahead thread may have queued
+// before it waits for the executing thread to catch up.
+#define PIPELINE_DEPTH 64
+
+// Called on the parse-ahead thread for every input line. Stores the parsed
+// command (or NULL for an empty line) in `*out` and any diagnostic of the
+// lexer (a string constant, or NULL) in `*message`, and returns non-zero if
+// the line contained a syntax error.
+typedef int (*pipeline_parse_fun)(char *line, struct tree_node **out,
+				  const char **message);
+
+// Called on the executing thread for every parsed line, in input order, so
+// that diagnostics appear between the output of the surrounding commands.
+// `n` is NULL if `error` is set.
+typedef void (*pipeline_run_fun)(struct tree_node *n, int error,
+				 const char *message);
+
+// Read lines from `f` and parse them with `parse` on a helper thread, while
+// the calling thread runs the resulting commands with `run`. Returns once
+// every line of `f` has been run. Commands for which `shell_may_exit`
+// returns non-zero are only run after the helper thread has been stopped.
+void pipeline_run(FILE *f, pipeline_parse_fun parse, pipeline_run_fun run);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,121 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "arena.h"
+#include "redir.h"
+#include "parser/ast.h"
+
+static const int open_flags[] = {
+    [REDIRECT_INPUT] = O_RDONLY,
+    [REDIRECT_OUTPUT] = O_WRONLY | O_CREAT | O_TRUNC,
+    [REDIRECT_APPEND] = O_WRONLY | O_CREAT | O_APPEND,
+};
+
+void redir_plan(node_t *n, struct redir_plan *plan) {
+    size_t n_ops = 0, i = 0;
+    node_t *cur;
+
+    // `&>` (fd -1) stands for both stdout and stderr
+    for (cur = n; cur->type == NODE_REDIRECT; cur = cur->redirect.child)
+        n_ops += cur->redirect.fd < 0 ? 2 : 1;
+
+    plan->ops = arena_malloc(n_ops, sizeof(struct redir_op));
+    plan->n_ops = n_ops;
+    plan->body = cur;
+    plan->saved = NULL;
+
+    for (cur = n; cur->type == NODE_REDIRECT; cur = cur->redirect.child) {
+        struct redir_op *op = &plan->ops[i++];
+
+        op->fd = cur->redirect.fd < 0 ? STDOUT_FILENO : cur->redirect.fd;
+        if (cur->redirect.mode == REDIRECT_DUP) {
+            op->src = cur->redirect.fd2;
+            op->path = NULL;
+            op->flags = 0;
+        } else {
+            op->src = REDIR_OPEN;
+            op->path = cur->redirect.target;
+            op->flags = open_flags[cur->redirect.mode];
+        }
+
+        // stderr shares whatever stdout got, like `>x 2>&1`
+        if (cur->redirect.fd < 0) {
+            op = &plan->ops[i++];
+            op->fd = STDERR_FILENO;
+            op->src = cur->redirect.mode == REDIRECT_DUP ?
+                      cur->redirect.fd2 : STDOUT_FILENO;
+            op->path = NULL;
+            op->flags = 0;
+        }
+    }
+}
+
+static int apply_op(const struct redir_op *op) {
+    int fd;
+
+    if (op->src != REDIR_OPEN) {
+        if (dup2(op->src, op->fd) == -1) {
+            fprintf(stderr, "%d: %s\n", op->src, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    fd = open(op->path, op->flags | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        perror(op->path);
+        return -1;
+    }
+    if (fd == op->fd)
+        return fcntl(fd, F_SETFD, 0);
+    if (dup2(fd, op->fd) == -1) {
+        perror("dup2");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int redir_apply(const struct redir_plan *plan) {
+    for (size_t i = 0; i < plan->n_ops; i++)
+        if (apply_op(&plan->ops[i]) == -1)
+            return -1;
+    return 0;
+}
+
+static void restore(struct redir_plan *plan, size_t n) {
+    fflush(NULL);
+    while (n-- > 0) {
+        int fd = plan->ops[n].fd;
+
+        if (plan->saved[n] == -1) {
+            close(fd);
+        } else {
+            dup2(plan->saved[n], fd);
+            close(plan->saved[n]);
+        }
+    }
+}
+
+int redir_save_apply(struct redir_plan *plan) {
+    plan->saved = arena_malloc(plan->n_ops, sizeof(int));
+
+    // Output buffered so far belongs to the old descriptors
+    fflush(NULL);
+    for (size_t i = 0; i < plan->n_ops; i++) {
+        plan->saved[i] = fcntl(plan->ops[i].fd, F_DUPFD_CLOEXEC, 10);
+        if (apply_op(&plan->ops[i]) == -1) {
+            restore(plan, i + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void redir_restore(struct redir_plan *plan) {
+    restore(plan, plan->n_ops);
+}
@@ -0,0 +1,56 @@
+#ifndef REDIR_H
+#define REDIR_H
+
+#include <stddef.h>
+
+struct tree_node;
+
+/*
+ * One step of a redirection: either open `path` with `flags` onto `fd`, or
+ * make `fd` a copy of `src`.
+ */
+struct redir_op {
+    int fd;
+    int src;          // REDIR_OPEN if `path` is to be opened instead
+    const char *path;
+    int flags;
+};
+
+#define REDIR_OPEN (-1)
+
+/*
+ * The file descriptor operations of a chain of NODE_REDIRECT nodes, in the
+ * order they are to be applied (outermost first), and the node they apply
+ * to. Built once per chain and used both by forked children and for
+ * built-ins run in the shell itself.
+ */
+struct redir_plan {
+    struct redir_op *ops;
+    size_t n_ops;
+    struct tree_node *body;
+
+    int *saved;       // Used by redir_save(); -1 for fds that were closed
+};
+
+/*
+ * Build the plan for the redirect chain starting at `n`. The plan is
+ * allocated in the current arena.
+ */
+void redir_plan(struct tree_node *n, struct redir_plan *plan);
+
+/*
+ * Apply `plan` to the current process; files are opened with O_CLOEXEC and
+ * only the target descriptors survive an exec. On failure an error has been
+ * printed, the remaining steps are skipped and -1 is returned.
+ */
+int redir_apply(const struct redir_plan *plan);
+
+/*
+ * Like redir_apply(), but remember the descriptors it replaces so that
+ * redir_restore() can put them back. On failure, the descriptors have
+ * already been restored.
+ */
+int redir_save_apply(struct redir_plan *plan);
+void redir_restore(struct redir_plan *plan);
+
+#endif
@@ -1,3 +1,6 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +10,11 @@
 #include "front.h"
 #include "parser/ast.h"
 #include "shell.h"
+#include "optimize.h"
+#include "path_index.h"
+#include "redir.h"
+#include "memo.h"
+#include "memstat.h"
 #include <signal.h>
 
 void my_free_tree(void *pt)
@@ -24,6 +32,61 @@ void shell_exit(void)
     // This code will be called on exit
 }
 
+/*
+ * Set while a subshell runs inside the shell process: `exit` jumps back to
+ * run_subshell() instead of ending the shell.
+ */
+static jmp_buf *subshell_exit = NULL;
+
+int is_builtin(const char *program) {
+    return strcmp(program, "exit") == 0 || strcmp(program, "cd") == 0 ||
+           strcmp(program, "memo") == 0 || strcmp(program, "memstat") == 0;
+}
+
+/*
+ * Run `program`, using its `path` from the PATH index when there is one.
+ * execvp is the fallback, both when the cached path has gone away and to
+ * search PATH entries the index leaves alone.
+ */
+static void exec_command(const char *path, char *program, char **argv) {
+    if (path != NULL)
+        execv(path, argv);
+    execvp(program, argv);
+}
+
+/*
+ * Fork and exec the external command `node` and wait for it. The child
+ * applies `plan` (if any) first, so redirected commands need no extra work
+ * in the shell itself.
+ */
+static void spawn_command(node_t *node, const struct redir_plan *plan) {
+    char *program = node->command.program;
+    char **argv = node->command.argv;
+
+    // Look up in the parent so the result is cached for later commands
+    const char *path = path_index_lookup(program);
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        if (plan != NULL && redir_apply(plan) == -1)
+            exit(EXIT_FAILURE);
+        exec_command(path, program, argv);
+        perror("execvp");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid > 0) {
+        int status;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+            fprintf(stderr, "%s: command failed with exit status %d\n", program, WEXITSTATUS(status));
+    } else {
+        perror("fork");
+    }
+}
+
 void execute_single_command(node_t *node) {
     if (node == NULL || node->type != NODE_COMMAND)
         return;
@@ -36,10 +99,16 @@ void execute_single_command(node_t *node) {
         int exit_code = 0;
         if (argv[1] != NULL)
             exit_code = atoi(argv[1]);
+        if (subshell_exit != NULL)
+            longjmp(*subshell_exit, 1);
         exit(exit_code);
     }
 
-    if (strcmp(program, "cd") == 0) {
+    if (strcmp(program, "memo") == 0) {
+        memo_run(argv);
+    } else if (strcmp(program, "memstat") == 0) {
+        memstat_print(stdout);
+    } else if (strcmp(program, "cd") == 0) {
         if (argv[1] != NULL) {
             if (chdir(argv[1]) == -1)
                 perror("cd");
@@ -47,88 +116,280 @@ void execute_single_command(node_t *node) {
             fprintf(stderr, "cd: missing argument\n");
         }
     } else {
-        pid_t pid = fork();
-        if (pid == 0) {
-            signal(SIGINT, SIG_DFL);
-            execvp(program, argv);
-            perror("execvp");
+        spawn_command(node, NULL);
+    }
+}
+
+int shell_may_exit(node_t *node) {
+    // Sequences nest to the right, so walk them without recursing
+    while (node != NULL && node->type == NODE_SEQUENCE) {
+        if (shell_may_exit(node->sequence.first))
+            return 1;
+        node = node->sequence.second;
+    }
+    if (node == NULL)
+        return 0;
+
+    switch (node->type) {
+    case NODE_COMMAND:
+        return strcmp(node->command.program, "exit") == 0;
+    case NODE_REDIRECT:
+        return shell_may_exit(node->redirect.child);
+    case NODE_LIST:
+        for (size_t i = 0; i < node->list.n_items; i++)
+            if (shell_may_exit(node->list.items[i]))
+                return 1;
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+static void run_pipe(node_t *node) {
+    int num_parts = node->pipe.n_parts;
+    int pipefd[num_parts - 1][2];
+    pid_t pids[num_parts];
+    // Program of each part that is exec'd directly, whose status the shell
+    // reports itself; NULL for parts that run in a child shell
+    const char *direct[num_parts];
+    int status;
+
+    for (int i = 0; i < num_parts - 1; i++) {
+        if (pipe(pipefd[i]) == -1) {
+            perror("pipe");
             exit(EXIT_FAILURE);
         }
+    }
 
-        if (pid > 0) {
-            int status;
-            waitpid(pid, &status, 0);
-            if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
-                fprintf(stderr, "%s: command failed with exit status %d\n", program, WEXITSTATUS(status));
-        } else {
+    // Children must not flush our buffered output a second time
+    fflush(NULL);
+
+    for (int i = 0; i < num_parts; i++) {
+        node_t *part = node->pipe.parts[i];
+        struct redir_plan plan = { .n_ops = 0, .body = part };
+        const char *path = NULL;
+        int spawn;
+
+        if (part->type == NODE_REDIRECT)
+            redir_plan(part, &plan);
+        spawn = plan.body->type == NODE_COMMAND && (part->flags & NODE_SPAWN_ONLY);
+        direct[i] = spawn ? plan.body->command.program : NULL;
+        if (spawn) {
+            opt_stats.spawn_forks_saved++;
+            path = path_index_lookup(plan.body->command.program);
+        }
+        pids[i] = fork();
+        if (pids[i] == -1) {
             perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pids[i] == 0) {
+            // Child process
+            subshell_exit = NULL;
+            if (i != 0) {
+                dup2(pipefd[i - 1][0], STDIN_FILENO); // Redirect stdin from previous pipe
+                close(pipefd[i - 1][0]); // Close read end of previous pipe
+            }
+            if (i != num_parts - 1) {
+                dup2(pipefd[i][1], STDOUT_FILENO); // Redirect stdout to next pipe
+                close(pipefd[i][1]); // Close write end of current pipe
+            }
+            for (int j = 0; j < num_parts - 1; j++) {
+                close(pipefd[j][0]); // Close read ends of all other pipes
+                close(pipefd[j][1]); // Close write ends of all other pipes
+            }
+            if (spawn) {
+                // Nothing to run in this process; exec the part directly
+                signal(SIGINT, SIG_DFL);
+                if (redir_apply(&plan) == -1)
+                    exit(EXIT_FAILURE);
+                exec_command(path, plan.body->command.program, plan.body->command.argv);
+                perror("execvp");
+                exit(EXIT_FAILURE);
+            }
+            run_command(part);
+            exit(EXIT_SUCCESS);
         }
     }
+
+    // Parent process
+    for (int i = 0; i < num_parts - 1; i++) {
+        close(pipefd[i][0]); // Close read ends of all pipes
+        close(pipefd[i][1]); // Close write ends of all pipes
+    }
+
+    // Wait for all child processes to complete
+    for (int i = 0; i < num_parts; i++) {
+        waitpid(pids[i], &status, 0);
+        if (direct[i] && WIFEXITED(status) && WEXITSTATUS(status) != 0)
+            fprintf(stderr, "%s: command failed with exit status %d\n", direct[i], WEXITSTATUS(status));
+    }
 }
 
-void run_command(node_t *node) {
-    arena_push(); // Create a new memory arena
+/*
+ * Run the redirect chain `node`. An external command gets the redirections
+ * in its child; anything else runs in the shell with the descriptors swapped
+ * out and back again.
+ */
+static void run_redirect(node_t *node) {
+    struct redir_plan plan;
 
-    if (node == NULL) {
-        arena_pop(); // Clean up memory arena
+    redir_plan(node, &plan);
+    if (plan.body->type == NODE_COMMAND && !is_builtin(plan.body->command.program)) {
+        spawn_command(plan.body, &plan);
         return;
     }
+    if (redir_save_apply(&plan) == -1)
+        return;
+    run_command(plan.body);
+    redir_restore(&plan);
+}
+
+/*
+ * Nodes still to be run, in reverse order. Shared by nested run_command
+ * calls (each one only uses the part above where it started) and kept
+ * between commands, so running a tree allocates nothing per node.
+ */
+static node_t **work = NULL;
+static size_t work_top = 0, work_cap = 0;
 
-    if (node->type == NODE_COMMAND) {
-        execute_single_command(node);
+static void free_work(void) {
+    free(work);
+}
+
+static void push_work(node_t *node) {
+    if (work_top == work_cap) {
+        if (work_cap == 0)
+            atexit(&free_work);
+        work_cap = work_cap ? 2 * work_cap : 64;
+        work = realloc(work, work_cap * sizeof(node_t *));
+        if (work == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
     }
-    
-    if (node->type == NODE_SEQUENCE) {
-        run_command(node->sequence.first);
-        run_command(node->sequence.second);
+    work[work_top++] = node;
+}
+
+/*
+ * Returns non-zero if the subshell body `node` can run in the shell process.
+ * The only shell state a body can change is the working directory, which
+ * run_subshell() restores, and whether the shell exits. Redirections of
+ * anything but an external command are done in the shell itself and would
+ * not be undone by an `exit`, so those bodies are forked.
+ */
+static int forkless(node_t *node) {
+    while (node->type == NODE_SEQUENCE) {
+        if (!forkless(node->sequence.first))
+            return 0;
+        node = node->sequence.second;
     }
-    
-    if (node->type == NODE_PIPE) {
-        int num_parts = node->pipe.n_parts;
-        int pipefd[num_parts - 1][2];
-        pid_t pids[num_parts];
-        int status;
 
-        for (int i = 0; i < num_parts - 1; i++) {
-            if (pipe(pipefd[i]) == -1) {
-                perror("pipe");
-                exit(EXIT_FAILURE);
-            }
-        }
+    switch (node->type) {
+    case NODE_COMMAND:
+    case NODE_PIPE:     // Parts run in their own processes
+    case NODE_SUBSHELL: // Isolates itself
+        return 1;
+    case NODE_LIST:
+        for (size_t i = 0; i < node->list.n_items; i++)
+            if (!forkless(node->list.items[i]))
+                return 0;
+        return 1;
+    case NODE_REDIRECT:
+        while (node->type == NODE_REDIRECT)
+            node = node->redirect.child;
+        return node->type == NODE_COMMAND && !is_builtin(node->command.program);
+    default:
+        return 0;
+    }
+}
 
-        for (int i = 0; i < num_parts; i++) {
-            pids[i] = fork();
-            if (pids[i] == -1) {
-                perror("fork");
-                exit(EXIT_FAILURE);
-            } else if (pids[i] == 0) {
-                // Child process
-                if (i != 0) {
-                    dup2(pipefd[i - 1][0], STDIN_FILENO); // Redirect stdin from previous pipe
-                    close(pipefd[i - 1][0]); // Close read end of previous pipe
-                }
-                if (i != num_parts - 1) {
-                    dup2(pipefd[i][1], STDOUT_FILENO); // Redirect stdout to next pipe
-                    close(pipefd[i][1]); // Close write end of current pipe
-                }
-                for (int j = 0; j < num_parts - 1; j++) {
-                    close(pipefd[j][0]); // Close read ends of all other pipes
-                    close(pipefd[j][1]); // Close write ends of all other pipes
-                }
-                run_command(node->pipe.parts[i]);
-                exit(EXIT_SUCCESS);
-            }
-        }
+/*
+ * Run the body of a subshell isolated from the shell. Bodies that allow it
+ * run in-process: the working directory is remembered as an fd and
+ * restored afterwards, and `exit` unwinds to here.
+ */
+static void run_subshell(node_t *node) {
+    node_t *body = node->subshell.child;
+    int cwd = -1;
 
-        // Parent process
-        for (int i = 0; i < num_parts - 1; i++) {
-            close(pipefd[i][0]); // Close read ends of all pipes
-            close(pipefd[i][1]); // Close write ends of all pipes
+    if (forkless(body))
+        cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (cwd != -1) {
+        jmp_buf env, *outer = subshell_exit;
+        size_t arenas = arena_amount(), top = work_top;
+
+        opt_stats.subshell_forks_saved++;
+        if (setjmp(env) == 0) {
+            subshell_exit = &env;
+            run_command(body);
+        } else {
+            // `exit` skipped the cleanup of the commands it was in
+            while (arena_amount() > arenas)
+                arena_pop();
+            work_top = top;
         }
+        subshell_exit = outer;
+        if (fchdir(cwd) == -1)
+            perror("cd");
+        close(cwd);
+        return;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        subshell_exit = NULL;
+        run_command(body);
+        exit(EXIT_SUCCESS);
+    }
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    else
+        perror("fork");
+}
+
+void run_command(node_t *node) {
+    size_t base = work_top;
+
+    if (node == NULL)
+        return;
+
+    arena_push(); // One memory arena for the whole command
+    push_work(node);
+
+    while (work_top > base) {
+        node = work[--work_top];
+
+        switch (node->type) {
+        case NODE_COMMAND:
+            execute_single_command(node);
+            break;
+
+        case NODE_SEQUENCE:
+            push_work(node->sequence.second);
+            push_work(node->sequence.first);
+            break;
+
+        case NODE_LIST:
+            for (size_t i = node->list.n_items; i > 0; i--)
+                push_work(node->list.items[i - 1]);
+            break;
+
+        case NODE_PIPE:
+            run_pipe(node);
+            break;
+
+        case NODE_REDIRECT:
+            run_redirect(node);
+            break;
+
+        case NODE_SUBSHELL:
+            run_subshell(node);
+            break;
 
-        // Wait for all child processes to complete
-        for (int i = 0; i < num_parts; i++) {
-            waitpid(pids[i], &status, 0);
+        default:
+            break;
         }
     }
 
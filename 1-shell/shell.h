@@ -26,6 +26,17 @@ void shell_exit(void);
  */
 void run_command(struct tree_node *n);
 
+/*
+ * Returns non-zero if `program` is run by the shell itself.
+ */
+int is_builtin(const char *program);
+
+/*
+ * Returns non-zero if running `n` may terminate the shell process itself,
+ * i.e. it runs the `exit` built-in outside of a forked child.
+ */
+int shell_may_exit(struct tree_node *n);
+
 /* ... */
 
 #endif
@@ -0,0 +1,454 @@
+/* De mem_alloc.h routines voor de simulator: ze sturen elke aanroep door  */
+/* naar de met mem_select gekozen implementatie en meten daarbij hoe lang  */
+/* mem_get en mem_free duren.                                              */
+
+/* Voor MAP_ANONYMOUS, MAP_NORESERVE en MADV_HUGEPAGE */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "mem_backend.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+static const mem_backend *backends[] =
+{
+    &choose_backend,
+    &segfit_backend,
+    &segfit_choose_backend,
+    &bestfit_backend,
+    &buddy_backend,
+    &tlsf_backend,
+};
+
+#define N_BACKENDS	((int) (sizeof(backends) / sizeof(backends[0])))
+
+static const mem_backend *backend = &choose_backend;
+static long *mem_ptr;
+
+long mem_size = MEM_SIZE_DEFAULT;
+static int use_hugepages;
+
+/* Gemeten tijden in nanoseconden */
+typedef struct latency
+{
+    long n;
+    double total, max;
+} latency;
+
+static latency get_latency, free_latency;
+static long n_failed;
+
+static double now_ns()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec * 1e9 + t.tv_nsec);
+}
+
+static void measured(latency *l, double start)
+{
+    double ns = now_ns() - start;
+
+    l->n++;
+    l->total += ns;
+    if (ns > l->max)
+    {
+	l->max = ns;
+    }
+}
+
+int mem_configure(long size, int hugepages)
+{
+    if (size < MEM_SIZE_MIN)
+    {
+	return (-1);
+    }
+    mem_size = size;
+    use_hugepages = hugepages;
+    return (0);
+}
+
+long *mem_map()
+{
+    void *mem = mmap(NULL, MEM_SIZE * sizeof(long), PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (mem == MAP_FAILED)
+    {
+	printf("Kan geen geheugen van %ld longs reserveren\n", MEM_SIZE);
+	exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (use_hugepages)
+    {
+	madvise(mem, MEM_SIZE * sizeof(long), MADV_HUGEPAGE);
+    }
+#endif
+    return ((long *) mem);
+}
+
+int mem_select(const char *name)
+{
+    int i;
+
+    for (i = 0; i < N_BACKENDS; i++)
+    {
+	if (strcmp(backends[i]->name, name) == 0)
+	{
+	    backend = backends[i];
+	    return (0);
+	}
+    }
+    return (-1);
+}
+
+void mem_list_backends()
+{
+    int i;
+
+    for (i = 0; i < N_BACKENDS; i++)
+    {
+	printf("  %-14s %s\n", backends[i]->name, backends[i]->description);
+    }
+}
+
+void mem_init(long *mem)
+{
+    mem_ptr = mem;
+    backend->init(mem);
+}
+
+long mem_get(long request)
+{
+    double start = now_ns();
+    long index = backend->get(request);
+
+    measured(&get_latency, start);
+    if (index < 0)
+    {
+	n_failed++;
+    }
+    return (index);
+}
+
+void mem_free(long index)
+{
+    double start = now_ns();
+
+    backend->free(index);
+    measured(&free_latency, start);
+}
+
+double mem_internal()
+{
+    return (backend->internal());
+}
+
+void mem_available(long *empty, long *large, long *n_holes)
+{
+    backend->available(empty, large, n_holes);
+}
+
+void mem_exit()
+{
+    backend->init(mem_ptr);
+}
+
+void mem_counters(mem_counts *c)
+{
+    c->backend = backend->name;
+    c->size = MEM_SIZE;
+    c->n_get = get_latency.n;
+    c->n_failed = n_failed;
+    c->n_free = free_latency.n;
+    c->get_ns_avg = get_latency.n ? get_latency.total / get_latency.n : 0.0;
+    c->get_ns_max = get_latency.max;
+    c->free_ns_avg = free_latency.n ? free_latency.total / free_latency.n : 0.0;
+    c->free_ns_max = free_latency.max;
+    c->empty = c->large = c->n_holes = 0;
+    c->internal = 0.0;
+    if (mem_ptr)
+    {
+	backend->available(&c->empty, &c->large, &c->n_holes);
+	c->internal = backend->internal();
+    }
+}
+
+void mem_report()
+{
+    mem_counts c;
+
+    mem_counters(&c);
+    printf("Geheugenbeheer: %s (%s), %ld woorden\n", c.backend,
+	   backend->description, c.size);
+    printf("mem_get: %ld keer, waarvan %ld mislukt, gemiddeld %.0f ns, "
+	   "maximaal %.0f ns\n", c.n_get, c.n_failed, c.get_ns_avg,
+	   c.get_ns_max);
+    printf("mem_free: %ld keer, gemiddeld %.0f ns, maximaal %.0f ns\n",
+	   c.n_free, c.free_ns_avg, c.free_ns_max);
+    if (mem_ptr)
+    {
+	printf("Vrij: %ld woorden in %ld gaten, grootste bruikbaar: %ld, "
+	       "interne fragmentatie: %6.4f\n", c.empty, c.n_holes, c.large,
+	       c.internal);
+    }
+}
+
+/* Statistieken voor implementaties met lengtes op het eerste en laatste
+   element van elk blok. Ze worden bij elke wijziging bijgewerkt, zodat
+   mem_available en mem_internal niet door het hele geheugen hoeven te lopen.
+
+   Het grootste gat staat bovenaan een max-heap van (lengte, begin) paren.
+   Een verdwenen gat wordt pas uit de heap gehaald als het bovenaan komt;
+   dat het nog bestaat blijkt, net als in mem_free, uit de lengtes op zijn
+   eerste en laatste element. */
+
+typedef struct hole
+{
+    long size, start;
+} hole;
+
+static const long *tags_mem;
+static long n_holes_now, n_free_now, n_blocks_now, n_alloc_now;
+static hole *heap;
+static long heap_len, heap_cap;
+
+static int hole_exists(hole h)
+{
+    return ((tags_mem[h.start] == -h.size) &&
+	    (tags_mem[h.start + h.size - 1] == -h.size));
+}
+
+static void heap_sift_down(long i)
+{
+    long child;
+    hole h = heap[i];
+
+    while ((child = 2 * i + 1) < heap_len)
+    {
+	if ((child + 1 < heap_len) && (heap[child + 1].size > heap[child].size))
+	{
+	    child++;
+	}
+	if (heap[child].size <= h.size)
+	{
+	    break;
+	}
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = h;
+}
+
+static int compare_start(const void *a, const void *b)
+{
+    long sa = ((const hole *) a)->start, sb = ((const hole *) b)->start;
+
+    return ((sa > sb) - (sa < sb));
+}
+
+/* Gooi de verdwenen gaten en dubbele paren uit de heap */
+static void heap_rebuild()
+{
+    long i, n = 0;
+
+    for (i = 0; i < heap_len; i++)
+    {
+	if (hole_exists(heap[i]))
+	{
+	    heap[n++] = heap[i];
+	}
+    }
+    qsort(heap, n, sizeof(hole), compare_start);
+    heap_len = 0;
+    for (i = 0; i < n; i++)
+    {
+	if ((heap_len == 0) || (heap[heap_len - 1].start != heap[i].start))
+	{
+	    heap[heap_len++] = heap[i];
+	}
+    }
+    for (i = heap_len / 2 - 1; i >= 0; i--)
+    {
+	heap_sift_down(i);
+    }
+}
+
+void mem_tags_reset(const long *mem)
+{
+    tags_mem = mem;
+    n_holes_now = n_free_now = n_blocks_now = n_alloc_now = 0;
+    heap_len = 0;
+}
+
+void mem_tags_hole_add(long start, long size)
+{
+    long i;
+    hole *grown;
+
+    n_holes_now++;
+    n_free_now += size;
+
+    /* Houd de heap hooguit ongeveer twee keer zo groot als het aantal
+       gaten */
+    if (heap_len > 2 * n_holes_now + 64)
+    {
+	heap_rebuild();
+    }
+    if (heap_len == heap_cap)
+    {
+	grown = realloc(heap, (heap_cap ? 2 * heap_cap : 256) * sizeof(hole));
+	if (!grown)
+	{
+	    printf("Geen geheugen voor de administratie van de gaten\n");
+	    exit(1);
+	}
+	heap = grown;
+	heap_cap = heap_cap ? 2 * heap_cap : 256;
+    }
+
+    for (i = heap_len++; (i > 0) && (heap[(i - 1) / 2].size < size);
+	 i = (i - 1) / 2)
+    {
+	heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i] = (hole) {size, start};
+}
+
+void mem_tags_hole_remove(long size)
+{
+    n_holes_now--;
+    n_free_now -= size;
+}
+
+void mem_tags_block_add(long size)
+{
+    n_blocks_now++;
+    n_alloc_now += size;
+}
+
+void mem_tags_block_remove(long size)
+{
+    n_blocks_now--;
+    n_alloc_now -= size;
+}
+
+#ifdef MEM_STATS_CHECK
+/* De statistieken door alle blokken te lopen, om de bijgehouden waarden te
+   controleren */
+static void walk_available(long *empty, long *large, long *n_holes)
+{
+    long index = 0, size;
+
+    *empty = 0;
+    *large = 0;
+    *n_holes = 0;
+
+    while (index < MEM_SIZE)
+    {
+	if (tags_mem[index] < 0)
+	{
+	    size = -tags_mem[index];
+	    *empty += size;
+	    *n_holes += 1;
+	    if (*large < size)
+	    {
+		*large = size;
+	    }
+	    index += size;
+	}
+	else
+	{
+	    index += tags_mem[index];
+	}
+    }
+    *large = (*large > 1) ? (*large - 2) : 0;
+}
+
+static double walk_internal()
+{
+    long index = 0, size, n_admin = 0, n_alloc = 0;
+
+    while (index < MEM_SIZE)
+    {
+	if (tags_mem[index] < 0)
+	{
+	    index -= tags_mem[index];
+	}
+	else
+	{
+	    size = tags_mem[index];
+	    n_alloc += size;
+	    n_admin += 2;
+	    index += size;
+	}
+    }
+
+    /* Deel niet door nul.
+       */
+    if (n_alloc <= n_admin)
+    {
+	return (0.0);
+    }
+    return (((double) n_admin) / ((double) (n_alloc - n_admin)));
+}
+#endif
+
+void mem_tags_available(long *empty, long *large, long *n_holes)
+{
+    long size = 0;
+
+    while ((heap_len > 0) && !hole_exists(heap[0]))
+    {
+	heap[0] = heap[--heap_len];
+	heap_sift_down(0);
+    }
+    if ((n_holes_now > 0) && (heap_len > 0))
+    {
+	size = heap[0].size;
+    }
+
+    *empty = n_free_now;
+    *large = (size > 1) ? (size - 2) : 0;
+    *n_holes = n_holes_now;
+
+#ifdef MEM_STATS_CHECK
+    {
+	long w_empty, w_large, w_holes;
+
+	walk_available(&w_empty, &w_large, &w_holes);
+	assert((w_empty == *empty) && (w_large == *large) &&
+	       (w_holes == *n_holes));
+    }
+#endif
+}
+
+double mem_tags_internal()
+{
+    long n_admin = 2 * n_blocks_now;
+    double frag = 0.0;
+
+    /* Deel niet door nul.
+       */
+    if (n_alloc_now > n_admin)
+    {
+	frag = ((double) n_admin) / ((double) (n_alloc_now - n_admin));
+    }
+
+#ifdef MEM_STATS_CHECK
+    assert(frag == walk_internal());
+#endif
+    return (frag);
+}
@@ -9,15 +9,34 @@
 
 /* Constanten */
 
-#define MEM_SIZE (32768)
+#define MEM_SIZE_DEFAULT (32768)
+
+/* De kleinste MEM_SIZE die mem_configure accepteert: de simulator vraagt
+   stukken van minstens 512 longs en er moeten er een paar tegelijk passen */
+#define MEM_SIZE_MIN (2048)
+
+/* MEM_SIZE is het aantal longs in het te beheren geheugen. De simulator
+   stelt het in (optie --memsize) voor de eerste aanroep van schedule;
+   daarna verandert het niet meer
+   */
+
+extern long mem_size;
+#define MEM_SIZE (mem_size)
 
 /* Procedures */
 
-void mem_init(long mem[MEM_SIZE]);
+long *mem_map();
+
+/* mem_map geeft een geheugen van MEM_SIZE longs, allemaal 0, om aan
+   mem_init te geven. Pagina's worden pas werkelijk toegewezen als ze
+   gebruikt worden, zodat ook een heel groot MEM_SIZE kan
+   */
+
+void mem_init(long *mem);
 
 /* mem_init wordt aangeroepen voor enige andere procedure uit deze file
    wordt gebruikt. Hij initialseert de memory-manager en zorgt ervoor
-   dat het te beheren geheugen daar bekend is
+   dat het te beheren geheugen (MEM_SIZE longs) daar bekend is
    */
 
 long mem_get(long request);
@@ -49,6 +68,8 @@ void mem_available(long *empty, long *large, long *n_holes);
    large:       omvang van het grootste gat, gecorrigeerd voor
                 administratie
    n_holes:     het aantal gaten
+   mem_available en mem_internal lopen niet door het geheugen en mogen
+   dus bij elk event aangeroepen worden
    */
 
 void mem_exit();
@@ -57,3 +78,47 @@ void mem_exit();
    het gebruik van de memory manager.
    Deze routine zorgt zonodig voor opruimen en afronden.
    */
+
+/* De volgende procedures zijn alleen voor de simulator */
+
+int mem_configure(long size, int hugepages);
+
+/* mem_configure stelt MEM_SIZE in en of mem_map om huge pages vraagt.
+   Geeft 0 terug, of -1 als size kleiner dan MEM_SIZE_MIN is.
+   */
+
+int mem_select(const char *name);
+
+/* mem_select kiest voor de aanroep van mem_init welke implementatie van
+   het geheugenbeheer gebruikt wordt. Geeft 0 terug, of -1 als er geen
+   implementatie met die naam is.
+   */
+
+void mem_list_backends();
+
+/* mem_list_backends drukt de namen van de implementaties af
+   */
+
+typedef struct mem_counts
+{
+    const char *backend;
+    long size, n_get, n_failed, n_free;
+    double get_ns_avg, get_ns_max, free_ns_avg, free_ns_max;
+    long empty, large, n_holes;
+    double internal;
+} mem_counts;
+
+void mem_counters(mem_counts *c);
+
+/* mem_counters vult c met de naam van de implementatie, MEM_SIZE, het
+   aantal aanroepen van mem_get (en hoeveel daarvan mislukten) en mem_free
+   met hun gemiddelde en maximale duur in ns, en de waarden van
+   mem_available en mem_internal (0 zolang mem_init niet is aangeroepen)
+   */
+
+void mem_report();
+
+/* mem_report drukt af hoe vaak mem_get en mem_free zijn aangeroepen en
+   hoe lang dat gemiddeld en maximaal duurde, met de fragmentatie zoals de
+   gekozen implementatie die meet
+   */
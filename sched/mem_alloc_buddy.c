@@ -0,0 +1,216 @@
+/* =================================
+ * Binary buddy versie van de mem_alloc.h routines
+ * =================================
+ * Het geheugen wordt verdeeld in blokken van 2^k elementen, elk op een
+ * veelvoud van zijn eigen grootte. Een aanvraag krijgt het kleinste blok
+ * waarin ze met een kopelement past; een groter blok wordt daarvoor steeds
+ * gehalveerd. Bij vrijgeven wordt een blok samengevoegd met zijn "buddy"
+ * (de andere helft van het blok waaruit het ontstond) zolang die vrij is.
+ *
+ * Een vrij blok van orde k heeft op zijn eerste element FREE_TAG(k) en in
+ * de twee elementen daarna de verwijzingen van de lijst van vrije blokken
+ * van die orde. Een toegewezen blok heeft op zijn eerste element de
+ * gevraagde grootte, waaruit de orde volgt.
+ *
+ * Als MEM_SIZE geen macht van 2 is, wordt het geheugen eerst in zo groot
+ * mogelijke blokken opgedeeld; een rest van minder dan 2^MIN_ORDER
+ * elementen wordt niet gebruikt.
+ */
+
+#include <assert.h>
+#include "mem_backend.h"
+
+static long *mem_ptr;
+
+#define MIN_ORDER	(2)
+#define N_ORDERS	(64)
+#define NONE		(-1)
+
+#define FREE_TAG(k)	(-1 - (k))
+#define NEXT(b)		(mem_ptr[(b) + 1])
+#define PREV(b)		(mem_ptr[(b) + 2])
+
+static long free_first[N_ORDERS], free_count[N_ORDERS];
+
+/* Voor mem_internal: het totaal van de gevraagde en van de toegewezen
+   elementen */
+static long n_requested, n_assigned;
+
+static int order_for(long need)
+{
+    int k = MIN_ORDER;
+
+    while ((1L << k) < need)
+    {
+	k++;
+    }
+    return (k);
+}
+
+static void push(long b, int k)
+{
+    mem_ptr[b] = FREE_TAG(k);
+    PREV(b) = NONE;
+    NEXT(b) = free_first[k];
+    if (free_first[k] != NONE)
+    {
+	PREV(free_first[k]) = b;
+    }
+    free_first[k] = b;
+    free_count[k]++;
+}
+
+static void unlink_block(long b, int k)
+{
+    if (PREV(b) == NONE)
+    {
+	free_first[k] = NEXT(b);
+    }
+    else
+    {
+	NEXT(PREV(b)) = NEXT(b);
+    }
+    if (NEXT(b) != NONE)
+    {
+	PREV(NEXT(b)) = PREV(b);
+    }
+    free_count[k]--;
+}
+
+static void buddy_init(long *mem)
+{
+    long b = 0;
+    int k;
+
+    mem_ptr = mem;
+    n_requested = n_assigned = 0;
+    for (k = 0; k < N_ORDERS; k++)
+    {
+	free_first[k] = NONE;
+	free_count[k] = 0;
+    }
+    while (MEM_SIZE - b >= (1L << MIN_ORDER))
+    {
+	k = order_for(MEM_SIZE - b + 1) - 1;
+	while ((b % (1L << k)) != 0)
+	{
+	    k--;
+	}
+	push(b, k);
+	b += 1L << k;
+    }
+}
+
+static long buddy_get(long size)
+{
+    long b;
+    int k, j;
+
+    if ((size < 1) || (size > MEM_SIZE - 1))
+    {
+	return (-1);
+    }
+    k = order_for(size + 1);
+    for (j = k; (j < N_ORDERS) && (free_first[j] == NONE); j++)
+	;
+    if (j >= N_ORDERS)
+    {
+	return (-1);
+    }
+    b = free_first[j];
+    unlink_block(b, j);
+
+    /* Halveer tot het blok de goede grootte heeft */
+    while (j > k)
+    {
+	j--;
+	push(b + (1L << j), j);
+    }
+    mem_ptr[b] = size;
+    n_requested += size;
+    n_assigned += 1L << k;
+
+    return (b + 1);
+}
+
+static void buddy_free(long index)
+{
+    long b = index - 1, buddy, size;
+    int k;
+
+    if ((index < 1) || (b >= MEM_SIZE) || (mem_ptr[b] < 1))
+    {
+	return;
+    }
+    size = mem_ptr[b];
+    k = order_for(size + 1);
+    if (((b % (1L << k)) != 0) || (b + (1L << k) > MEM_SIZE))
+    {
+	return;
+    }
+    n_requested -= size;
+    n_assigned -= 1L << k;
+
+    /* Voeg samen zolang de buddy een vrij blok van dezelfde orde is */
+    for (;;)
+    {
+	buddy = b ^ (1L << k);
+	if ((buddy + (1L << k) > MEM_SIZE) || (mem_ptr[buddy] != FREE_TAG(k)))
+	{
+	    break;
+	}
+	unlink_block(buddy, k);
+	b = (b < buddy) ? b : buddy;
+	k++;
+    }
+    push(b, k);
+}
+
+/* De fractie van de toegewezen elementen die niet gevraagd werd: het
+   kopelement en het afronden op een macht van 2 */
+static double buddy_internal()
+{
+    if (n_requested == 0)
+    {
+	return (0.0);
+    }
+    return (((double) (n_assigned - n_requested)) / ((double) n_requested));
+}
+
+static void buddy_available(long *empty, long *large, long *n_holes)
+{
+    int k;
+
+    *empty = 0;
+    *large = 0;
+    *n_holes = 0;
+    for (k = 0; k < N_ORDERS; k++)
+    {
+	if (free_count[k] > 0)
+	{
+	    *empty += free_count[k] << k;
+	    *n_holes += free_count[k];
+	    *large = 1L << k;
+	}
+    }
+    *large = (*large > 0) ? (*large - 1) : 0;
+
+#ifdef MEM_STATS_CHECK
+    for (k = 0; k < N_ORDERS; k++)
+    {
+	long b, n = 0;
+
+	for (b = free_first[k]; b != NONE; b = NEXT(b))
+	{
+	    n++;
+	}
+	assert(n == free_count[k]);
+    }
+#endif
+}
+
+const mem_backend buddy_backend =
+{
+    "buddy", "binary buddy",
+    buddy_init, buddy_get, buddy_free, buddy_internal, buddy_available
+};
@@ -25,19 +25,21 @@
 /* Versie:	0.01							*/
 /*									*/
 
-#include "mem_alloc.h"
+#include "mem_backend.h"
 
 static long *mem_ptr;
 
 #define	ADMIN_SIZE	(2)
 
-void mem_init(long mem[MEM_SIZE])
+static void choose_init(long *mem)
 {
     mem_ptr = mem;
     mem[0] = mem[MEM_SIZE - 1] = -MEM_SIZE;
+    mem_tags_reset(mem);
+    mem_tags_hole_add(0, MEM_SIZE);
 }
 
-long mem_get(long size)
+static long choose_get(long size)
 {
     long index = 0,	/* Het eerste element van het onderzochte blok */
 	end,		/* Het laatste element van een toegewezen blok */
@@ -67,9 +69,11 @@ long mem_get(long size)
     }
     free2 = index2 + mem_ptr[index2] + 1;
     last_free = index - mem_ptr[index] - 1;
+    mem_tags_block_add(size + ADMIN_SIZE);
     if ((last_free + free2) < MEM_SIZE)
     {
         end       = index + size + 1;
+	mem_tags_hole_remove(-mem_ptr[index]);
 
         /* Als ik alles toewijs, zou end+1 in het volgende blok vallen;
            afblijven dus
@@ -78,6 +82,7 @@ long mem_get(long size)
         {
 	    mem_ptr[last_free] = mem_ptr[end + 1] =
 				mem_ptr[index] + size + ADMIN_SIZE;
+	    mem_tags_hole_add(end + 1, last_free - end);
         }
         mem_ptr[index] = mem_ptr[end] = size + ADMIN_SIZE;
 
@@ -87,6 +92,7 @@ long mem_get(long size)
         return (index + 1);
     } 
     end2       = index2 - size - 1;
+    mem_tags_hole_remove(-mem_ptr[index2]);
 
     /* Als ik alles toewijs, zou end2-1 in het volgende blok vallen;
        afblijven dus
@@ -95,6 +101,7 @@ long mem_get(long size)
     {
 	mem_ptr[free2] = mem_ptr[end2 - 1] =
 				mem_ptr[index2] + size + ADMIN_SIZE;
+	mem_tags_hole_add(free2, end2 - free2);
     }
     mem_ptr[index2] = mem_ptr[end2] = size + ADMIN_SIZE;
 
@@ -102,7 +109,7 @@ long mem_get(long size)
     
 }
 
-void mem_free(long index)
+static void choose_free(long index)
 {
     long start, end;
 
@@ -122,11 +129,13 @@ void mem_free(long index)
     {
 	return;
     }
+    mem_tags_block_remove(mem_ptr[start]);
 
 
     mem_ptr[start] = -mem_ptr[start];
     if ((start > 0) && (mem_ptr[start - 1] < 0))
     {
+	mem_tags_hole_remove(-mem_ptr[start - 1]);
 	start += mem_ptr[start - 1];
 	mem_ptr[start] -= mem_ptr[end];
     }
@@ -134,39 +143,17 @@ void mem_free(long index)
 
     if ((end < MEM_SIZE - 1) && (mem_ptr[end + 1] < 0))
     {
+	mem_tags_hole_remove(-mem_ptr[end + 1]);
 	end -= mem_ptr[end + 1];
 	mem_ptr[end] += mem_ptr[start];
         mem_ptr[start] = mem_ptr[end];
     }
+    mem_tags_hole_add(start, end - start + 1);
 }
 
-void mem_available(long *empty, long *large, long *n_hole)
+static void choose_available(long *empty, long *large, long *n_hole)
 {
-    long index = 0, size;
-
-    *empty = 0;
-    *large = 0;
-    *n_hole = 0;
-
-    while (index < MEM_SIZE)
-    {
-	if (mem_ptr[index] < 0)
-	{
-	    size = -mem_ptr[index];
-	    *empty += size;
-	    *n_hole += 1;
-	    if (*large < size)
-	    {
-		*large = size;
-	    }
-	    index += size;
-	}
-	else
-	{
-	    index += mem_ptr[index];
-	}
-    }
-    *large = (*large > 1) ? (*large - ADMIN_SIZE) : 0;
+    mem_tags_available(empty, large, n_hole);
 
 
 #ifdef	CORRECT_EMPTY
@@ -174,38 +161,13 @@ void mem_available(long *empty, long *large, long *n_hole)
 #endif
 }
 
-double mem_internal()
+static double choose_internal()
 {
-    long    index = 0, size, n_admin = 0, n_alloc = 0;
-    double frag;
-
-    while (index < MEM_SIZE)
-    {
-	if (mem_ptr[index] < 0)
-	{
-	    index -= mem_ptr[index];
-	}
-	else
-	{
-	    size = mem_ptr[index];
-	    n_alloc += size;
-	    n_admin += 2;
-	    index += size;
-	}
-    }
-
-    /* Deel niet door nul.
-       */
-    if (n_alloc <= n_admin)
-    {
-	return (0.0);
-    }
-    frag = ((double) n_admin) / ((double) (n_alloc - n_admin));
-
-    return (frag);
+    return (mem_tags_internal());
 }
 
-void mem_exit()
+const mem_backend choose_backend =
 {
-    mem_init(mem_ptr);
-}
+    "choose", "first fit van voren of van achteren",
+    choose_init, choose_get, choose_free, choose_internal, choose_available
+};
@@ -0,0 +1,362 @@
+/* =================================
+ * Segregated-fit versie van de mem_alloc.h routines
+ * =================================
+ * Zelfde indeling van het geheugen als mem_alloc_choose.c: elk blok heeft
+ * op zijn eerste en laatste element zijn lengte, negatief voor een vrij
+ * blok. Daarnaast staat elk vrij blok van minstens MIN_LISTED elementen
+ * in een dubbel verbonden lijst per grootteklasse. De verwijzingen staan
+ * in het tweede en derde element van het vrije blok zelf.
+ *
+ * Drie varianten:
+ * segfit        - mem_get zoekt eerst in de klasse van de aanvraag het
+ *                 eerste passende blok en neemt anders het eerste blok uit
+ *                 een hogere klasse; vrij gegeven blokken komen vooraan hun
+ *                 lijst.
+ * segfit-choose - de lijsten worden op adres gesorteerd gehouden en mem_get
+ *                 kiest precies zoals mem_alloc_choose.c tussen het eerste
+ *                 passende blok van voren en het eerste van achteren.
+ *                 mem_free wordt daardoor O(lengte van de lijst).
+ * bestfit       - mem_get neemt het kleinste passende blok: het kleinste in
+ *                 de eigen klasse, of anders het kleinste in de eerste niet
+ *                 lege hogere klasse.
+ *
+ * Vrije blokken van minder dan MIN_LISTED elementen worden niet in een lijst
+ * opgenomen; een aanvraag van 1 element kan dus geen gat van 3 elementen
+ * gebruiken, wat mem_alloc_choose.c wel doet.
+ */
+
+#include "mem_backend.h"
+
+static long *mem_ptr;
+
+static enum { GOOD_FIT, TWO_ENDED, BEST_FIT } mode;
+
+#define ADMIN_SIZE	(2)
+#define MIN_LISTED	(4)
+#define N_CLASSES	(64)
+#define NONE		(-1)
+
+/* De verwijzingen in een vrij blok dat begint op index b */
+#define NEXT(b)		(mem_ptr[(b) + 1])
+#define PREV(b)		(mem_ptr[(b) + 2])
+
+/* Klasse k bevat de vrije blokken met 2^k <= lengte < 2^(k+1) */
+static long class_first[N_CLASSES], class_last[N_CLASSES];
+
+static int size_class(long size)
+{
+    int k = 0;
+
+    while (size > 1)
+    {
+	size >>= 1;
+	k++;
+    }
+    return (k);
+}
+
+static void set_tags(long start, long size, long tag)
+{
+    mem_ptr[start] = mem_ptr[start + size - 1] = tag;
+}
+
+static void list_insert(long b, long size)
+{
+    int k;
+    long after;
+
+    mem_tags_hole_add(b, size);
+    if (size < MIN_LISTED)
+    {
+	return;
+    }
+    k = size_class(size);
+
+    after = NONE;
+    if (mode == TWO_ENDED)
+    {
+	/* Zoek het laatste blok met een lager adres */
+	after = class_last[k];
+	while ((after != NONE) && (after > b))
+	{
+	    after = PREV(after);
+	}
+    }
+
+    PREV(b) = after;
+    NEXT(b) = (after == NONE) ? class_first[k] : NEXT(after);
+    if (after == NONE)
+    {
+	class_first[k] = b;
+    }
+    else
+    {
+	NEXT(after) = b;
+    }
+    if (NEXT(b) == NONE)
+    {
+	class_last[k] = b;
+    }
+    else
+    {
+	PREV(NEXT(b)) = b;
+    }
+}
+
+static void list_remove(long b, long size)
+{
+    int k;
+
+    mem_tags_hole_remove(size);
+    if (size < MIN_LISTED)
+    {
+	return;
+    }
+    k = size_class(size);
+
+    if (PREV(b) == NONE)
+    {
+	class_first[k] = NEXT(b);
+    }
+    else
+    {
+	NEXT(PREV(b)) = NEXT(b);
+    }
+    if (NEXT(b) == NONE)
+    {
+	class_last[k] = PREV(b);
+    }
+    else
+    {
+	PREV(NEXT(b)) = PREV(b);
+    }
+}
+
+static void segfit_init(long *mem)
+{
+    int k;
+
+    mem_ptr = mem;
+    mem_tags_reset(mem);
+    for (k = 0; k < N_CLASSES; k++)
+    {
+	class_first[k] = class_last[k] = NONE;
+    }
+    set_tags(0, MEM_SIZE, -MEM_SIZE);
+    list_insert(0, MEM_SIZE);
+}
+
+/* Het eerste blok van minstens need elementen in klasse k, van voren
+   (forward) of van achteren gezocht */
+static long class_fit(int k, long need, int forward)
+{
+    long b = forward ? class_first[k] : class_last[k];
+
+    while ((b != NONE) && (-mem_ptr[b] < need))
+    {
+	b = forward ? NEXT(b) : PREV(b);
+    }
+    return (b);
+}
+
+/* Het kleinste blok van minstens need elementen in klasse k */
+static long class_best(int k, long need)
+{
+    long b, best = NONE;
+
+    for (b = class_first[k]; b != NONE; b = NEXT(b))
+    {
+	if ((-mem_ptr[b] >= need) &&
+	    ((best == NONE) || (mem_ptr[b] > mem_ptr[best])))
+	{
+	    best = b;
+	}
+    }
+    return (best);
+}
+
+/* Wijs need elementen toe aan het begin (at_end == 0) of het eind van het
+   vrije blok op index b en geef de index voor de aanvrager terug */
+static long take(long b, long need, int at_end)
+{
+    long size = -mem_ptr[b], start;
+
+    list_remove(b, size);
+    if (size == need)
+    {
+	start = b;
+    }
+    else if (at_end)
+    {
+	start = b + size - need;
+	set_tags(b, size - need, need - size);
+	list_insert(b, size - need);
+    }
+    else
+    {
+	start = b;
+	set_tags(b + need, size - need, need - size);
+	list_insert(b + need, size - need);
+    }
+    set_tags(start, need, need);
+    mem_tags_block_add(need);
+
+    /* De aanvrager mag het blok van start+1 t/m start+need-2 gebruiken. De
+       elementen op start en start+need-1 bevatten administratie van het
+       systeem
+       */
+    return (start + 1);
+}
+
+static long segfit_get(long size)
+{
+    long need = size + ADMIN_SIZE, b, front, back;
+    int k, k0;
+
+    if ((size < 1) || (size > MEM_SIZE - ADMIN_SIZE))
+    {
+	return (-1);
+    }
+    k0 = size_class(need);
+
+    switch (mode)
+    {
+    case TWO_ENDED:
+	front = class_fit(k0, need, 1);
+	back = class_fit(k0, need, 0);
+
+	/* In hogere klassen past elk blok: het eerste en het laatste dus */
+	for (k = k0 + 1; k < N_CLASSES; k++)
+	{
+	    if (class_first[k] == NONE)
+	    {
+		continue;
+	    }
+	    if ((front == NONE) || (class_first[k] < front))
+	    {
+		front = class_first[k];
+	    }
+	    if ((back == NONE) || (class_last[k] > back))
+	    {
+		back = class_last[k];
+	    }
+	}
+	if (front == NONE)
+	{
+	    return (-1);
+	}
+
+	/* Kies de kant waar het gevonden blok het dichtst bij de rand ligt */
+	if ((front - mem_ptr[front] - 1) + back < MEM_SIZE)
+	{
+	    return (take(front, need, 0));
+	}
+	return (take(back, need, 1));
+
+    case BEST_FIT:
+	b = class_best(k0, need);
+	for (k = k0 + 1; (b == NONE) && (k < N_CLASSES); k++)
+	{
+	    b = class_best(k, need);
+	}
+	break;
+
+    default:
+	b = class_fit(k0, need, 1);
+	for (k = k0 + 1; (b == NONE) && (k < N_CLASSES); k++)
+	{
+	    b = class_first[k];
+	}
+	break;
+    }
+    if (b == NONE)
+    {
+	return (-1);
+    }
+    return (take(b, need, 0));
+}
+
+static void segfit_free(long index)
+{
+    long start, end, size;
+
+    if ((index < 1) || (index > MEM_SIZE - ADMIN_SIZE))
+    {
+	return;
+    }
+    start = index - 1;
+
+    if (mem_ptr[start] < ADMIN_SIZE)
+    {
+	return;
+    }
+    size = mem_ptr[start];
+    end = start + size - 1;
+
+    if ((end >= MEM_SIZE) || (mem_ptr[start] != mem_ptr[end]))
+    {
+	return;
+    }
+    mem_tags_block_remove(size);
+
+    /* Voeg samen met vrije buren */
+    if ((start > 0) && (mem_ptr[start - 1] < 0))
+    {
+	start += mem_ptr[start - 1];
+	list_remove(start, -mem_ptr[start]);
+	size -= mem_ptr[start];
+    }
+    if ((end < MEM_SIZE - 1) && (mem_ptr[end + 1] < 0))
+    {
+	list_remove(end + 1, -mem_ptr[end + 1]);
+	size -= mem_ptr[end + 1];
+    }
+    set_tags(start, size, -size);
+    list_insert(start, size);
+}
+
+static void segfit_available(long *empty, long *large, long *n_holes)
+{
+    mem_tags_available(empty, large, n_holes);
+}
+
+static double segfit_internal()
+{
+    return (mem_tags_internal());
+}
+
+static void good_fit_init(long *mem)
+{
+    mode = GOOD_FIT;
+    segfit_init(mem);
+}
+
+static void two_ended_init(long *mem)
+{
+    mode = TWO_ENDED;
+    segfit_init(mem);
+}
+
+static void best_fit_init(long *mem)
+{
+    mode = BEST_FIT;
+    segfit_init(mem);
+}
+
+const mem_backend segfit_backend =
+{
+    "segfit", "vrije lijsten per grootteklasse",
+    good_fit_init, segfit_get, segfit_free, segfit_internal, segfit_available
+};
+
+const mem_backend segfit_choose_backend =
+{
+    "segfit-choose", "vrije lijsten, plaatsing als choose",
+    two_ended_init, segfit_get, segfit_free, segfit_internal, segfit_available
+};
+
+const mem_backend bestfit_backend =
+{
+    "bestfit", "best fit met vrije lijsten per grootteklasse",
+    best_fit_init, segfit_get, segfit_free, segfit_internal, segfit_available
+};
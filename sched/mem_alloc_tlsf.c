@@ -0,0 +1,246 @@
+/* =================================
+ * TLSF (two-level segregated fit) versie van de mem_alloc.h routines
+ * =================================
+ * Zelfde indeling van het geheugen als mem_alloc_choose.c: elk blok heeft
+ * op zijn eerste en laatste element zijn lengte, negatief voor een vrij
+ * blok. De vrije blokken staan in lijsten per klasse: het eerste niveau is
+ * de macht van 2 van de lengte, het tweede verdeelt die in SL_COUNT gelijke
+ * stukken. Bitmaps geven aan welke lijsten niet leeg zijn.
+ *
+ * mem_get rondt de aanvraag af naar de eerstvolgende klassegrens, zodat elk
+ * blok in de gevonden lijst past, en vindt die lijst met twee bitmap
+ * operaties: toewijzen en vrijgeven zijn O(1). Daar staat tegenover dat een
+ * passend blok in de eigen klasse van de aanvraag niet gevonden wordt.
+ *
+ * Vrije blokken van minder dan MIN_LISTED elementen worden, net als in
+ * mem_alloc_segfit.c, niet in een lijst opgenomen.
+ */
+
+#include "mem_backend.h"
+
+static long *mem_ptr;
+
+#define ADMIN_SIZE	(2)
+#define MIN_LISTED	(4)
+#define SL_BITS		(4)
+#define SL_COUNT	(1 << SL_BITS)
+#define FL_COUNT	(64 - SL_BITS)
+#define NONE		(-1)
+
+#define NEXT(b)		(mem_ptr[(b) + 1])
+#define PREV(b)		(mem_ptr[(b) + 2])
+
+static unsigned long fl_bitmap;
+static unsigned long sl_bitmap[FL_COUNT];
+static long heads[FL_COUNT][SL_COUNT];
+
+static int floor_log2(unsigned long x)
+{
+    return ((int) (8 * sizeof(unsigned long)) - 1 - __builtin_clzl(x));
+}
+
+/* De klasse van een blok van size elementen */
+static void mapping(long size, int *fl, int *sl)
+{
+    int f;
+
+    if (size < SL_COUNT)
+    {
+	*fl = 0;
+	*sl = (int) size;
+	return;
+    }
+    f = floor_log2(size);
+    *fl = f - SL_BITS + 1;
+    *sl = (int) ((size >> (f - SL_BITS)) - SL_COUNT);
+}
+
+static void set_tags(long start, long size, long tag)
+{
+    mem_ptr[start] = mem_ptr[start + size - 1] = tag;
+}
+
+static void list_insert(long b, long size)
+{
+    int fl, sl;
+
+    mem_tags_hole_add(b, size);
+    if (size < MIN_LISTED)
+    {
+	return;
+    }
+    mapping(size, &fl, &sl);
+    PREV(b) = NONE;
+    NEXT(b) = heads[fl][sl];
+    if (heads[fl][sl] != NONE)
+    {
+	PREV(heads[fl][sl]) = b;
+    }
+    heads[fl][sl] = b;
+    fl_bitmap |= 1UL << fl;
+    sl_bitmap[fl] |= 1UL << sl;
+}
+
+static void list_remove(long b, long size)
+{
+    int fl, sl;
+
+    mem_tags_hole_remove(size);
+    if (size < MIN_LISTED)
+    {
+	return;
+    }
+    mapping(size, &fl, &sl);
+    if (PREV(b) == NONE)
+    {
+	heads[fl][sl] = NEXT(b);
+    }
+    else
+    {
+	NEXT(PREV(b)) = NEXT(b);
+    }
+    if (NEXT(b) != NONE)
+    {
+	PREV(NEXT(b)) = PREV(b);
+    }
+    if (heads[fl][sl] == NONE)
+    {
+	sl_bitmap[fl] &= ~(1UL << sl);
+	if (sl_bitmap[fl] == 0)
+	{
+	    fl_bitmap &= ~(1UL << fl);
+	}
+    }
+}
+
+static void tlsf_init(long *mem)
+{
+    int fl, sl;
+
+    mem_ptr = mem;
+    mem_tags_reset(mem);
+    fl_bitmap = 0;
+    for (fl = 0; fl < FL_COUNT; fl++)
+    {
+	sl_bitmap[fl] = 0;
+	for (sl = 0; sl < SL_COUNT; sl++)
+	{
+	    heads[fl][sl] = NONE;
+	}
+    }
+    set_tags(0, MEM_SIZE, -MEM_SIZE);
+    list_insert(0, MEM_SIZE);
+}
+
+/* Een vrij blok van minstens need elementen, of NONE */
+static long find_block(long need)
+{
+    unsigned long map;
+    int fl, sl;
+
+    if (need >= SL_COUNT)
+    {
+	need += (1L << (floor_log2(need) - SL_BITS)) - 1;
+    }
+    mapping(need, &fl, &sl);
+    if (fl >= FL_COUNT)
+    {
+	return (NONE);
+    }
+
+    map = sl_bitmap[fl] & (~0UL << sl);
+    if (map == 0)
+    {
+	map = (fl + 1 < FL_COUNT) ? (fl_bitmap & (~0UL << (fl + 1))) : 0;
+	if (map == 0)
+	{
+	    return (NONE);
+	}
+	fl = __builtin_ctzl(map);
+	map = sl_bitmap[fl];
+    }
+    sl = __builtin_ctzl(map);
+    return (heads[fl][sl]);
+}
+
+static long tlsf_get(long size)
+{
+    long need = size + ADMIN_SIZE, b, rest;
+
+    if ((size < 1) || (size > MEM_SIZE - ADMIN_SIZE))
+    {
+	return (-1);
+    }
+    b = find_block(need);
+    if (b == NONE)
+    {
+	return (-1);
+    }
+
+    rest = -mem_ptr[b] - need;
+    list_remove(b, -mem_ptr[b]);
+    if (rest > 0)
+    {
+	set_tags(b + need, rest, -rest);
+	list_insert(b + need, rest);
+    }
+    set_tags(b, need, need);
+    mem_tags_block_add(need);
+
+    return (b + 1);
+}
+
+static void tlsf_free(long index)
+{
+    long start, end, size;
+
+    if ((index < 1) || (index > MEM_SIZE - ADMIN_SIZE))
+    {
+	return;
+    }
+    start = index - 1;
+
+    if (mem_ptr[start] < ADMIN_SIZE)
+    {
+	return;
+    }
+    size = mem_ptr[start];
+    end = start + size - 1;
+
+    if ((end >= MEM_SIZE) || (mem_ptr[start] != mem_ptr[end]))
+    {
+	return;
+    }
+    mem_tags_block_remove(size);
+
+    /* Voeg samen met vrije buren */
+    if ((start > 0) && (mem_ptr[start - 1] < 0))
+    {
+	start += mem_ptr[start - 1];
+	list_remove(start, -mem_ptr[start]);
+	size -= mem_ptr[start];
+    }
+    if ((end < MEM_SIZE - 1) && (mem_ptr[end + 1] < 0))
+    {
+	list_remove(end + 1, -mem_ptr[end + 1]);
+	size -= mem_ptr[end + 1];
+    }
+    set_tags(start, size, -size);
+    list_insert(start, size);
+}
+
+static void tlsf_available(long *empty, long *large, long *n_holes)
+{
+    mem_tags_available(empty, large, n_holes);
+}
+
+static double tlsf_internal()
+{
+    return (mem_tags_internal());
+}
+
+const mem_backend tlsf_backend =
+{
+    "tlsf", "two-level segregated fit",
+    tlsf_init, tlsf_get, tlsf_free, tlsf_internal, tlsf_available
+};
@@ -0,0 +1,40 @@
+/* Gemeenschappelijke definities voor de implementaties van mem_alloc.h.   */
+/* Elke implementatie levert een mem_backend; mem_alloc.c kiest er een en  */
+/* stuurt de aanroepen van mem_init, mem_get, enz. daarnaar door.          */
+
+#ifndef MEM_BACKEND_H
+#define MEM_BACKEND_H
+
+#include "mem_alloc.h"
+
+typedef struct mem_backend
+{
+    const char *name;
+    const char *description;
+    void (*init)(long *mem);
+    long (*get)(long request);
+    void (*free)(long index);
+    double (*internal)(void);
+    void (*available)(long *empty, long *large, long *n_holes);
+} mem_backend;
+
+extern const mem_backend choose_backend, segfit_backend, segfit_choose_backend,
+    bestfit_backend, buddy_backend, tlsf_backend;
+
+/* Voor implementaties die, zoals mem_alloc_choose.c, op het eerste en
+   laatste element van elk blok de lengte bijhouden (negatief als het blok
+   vrij is). Ze melden elk gat en elk toegewezen blok (lengtes inclusief
+   administratie) dat ontstaat of verdwijnt; mem_tags_available en
+   mem_tags_internal geven dan zonder door het geheugen te lopen de waarden
+   voor mem_available en mem_internal. Met MEM_STATS_CHECK gedefinieerd
+   worden ze bij elke aanroep met een volledige doorloop vergeleken. */
+
+void mem_tags_reset(const long *mem);
+void mem_tags_hole_add(long start, long size);
+void mem_tags_hole_remove(long size);
+void mem_tags_block_add(long size);
+void mem_tags_block_remove(long size);
+void mem_tags_available(long *empty, long *large, long *n_holes);
+double mem_tags_internal(void);
+
+#endif /* MEM_BACKEND_H */
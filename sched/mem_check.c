@@ -0,0 +1,183 @@
+/* =================================
+ * Testprogramma voor de implementaties van mem_alloc.h
+ * =================================
+ * Voert voor elke implementatie (of de op de opdrachtregel genoemde) een
+ * willekeurige reeks aanvragen en vrijgaven uit. Elk toegewezen stuk wordt
+ * gevuld met een eigen waarde, die bij het vrijgeven gecontroleerd wordt:
+ * zo wordt gemerkt als stukken overlappen of als de administratie van de
+ * implementatie erin schrijft. Na elke stap worden mem_available en
+ * mem_internal aangeroepen; gebouwd met -DMEM_STATS_CHECK (make memcheck)
+ * vergelijken die hun bijgehouden waarden dan met een volledige doorloop.
+ *
+ * Gebruik: mem_check [-s seed] [-n stappen] [-r grootste aanvraag]
+ *                    [-m MEM_SIZE] [implementatie...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem_backend.h"
+
+#define MAX_LIVE	(4096)
+
+static const mem_backend *all_backends[] =
+{
+    &choose_backend,
+    &segfit_backend,
+    &segfit_choose_backend,
+    &bestfit_backend,
+    &buddy_backend,
+    &tlsf_backend,
+};
+
+#define N_ALL	((int) (sizeof(all_backends) / sizeof(all_backends[0])))
+
+static long live[MAX_LIVE], len[MAX_LIVE], tag[MAX_LIVE];
+
+/* Een aanvraag: meestal klein, soms tot max_request groot */
+static long request_size(long max_request)
+{
+    if ((rand() % 8) == 0)
+    {
+	return (1 + rand() % max_request);
+    }
+    return (1 + rand() % ((max_request < 64) ? max_request : 64));
+}
+
+/* Voert n_steps stappen uit met de gekozen implementatie. Geeft 0 terug,
+   of -1 als er iets mis ging */
+static int run(const char *name, long *mem, long n_steps, long max_request,
+	       unsigned seed)
+{
+    long n_live = 0, next_tag = 1, n_failed = 0, step, i, j, k;
+    long empty, large, n_holes;
+
+    memset(mem, 0, MEM_SIZE * sizeof(long));
+    srand(seed);
+    mem_init(mem);
+
+    for (step = 0; step < n_steps; step++)
+    {
+	if ((n_live > 0) && (((rand() % 2) == 0) || (n_live == MAX_LIVE)))
+	{
+	    k = rand() % n_live;
+	    for (j = 0; j < len[k]; j++)
+	    {
+		if (mem[live[k] + j] != tag[k])
+		{
+		    printf("%s: stap %ld: stuk op %ld (%ld longs) is "
+			   "overschreven op %ld\n", name, step, live[k], len[k],
+			   live[k] + j);
+		    return (-1);
+		}
+	    }
+	    mem_free(live[k]);
+	    n_live--;
+	    live[k] = live[n_live];
+	    len[k] = len[n_live];
+	    tag[k] = tag[n_live];
+	}
+	else
+	{
+	    long size = request_size(max_request);
+
+	    i = mem_get(size);
+	    if (i < 0)
+	    {
+		n_failed++;
+	    }
+	    else if (i + size > MEM_SIZE)
+	    {
+		printf("%s: stap %ld: mem_get(%ld) gaf %ld, buiten het "
+		       "geheugen\n", name, step, size, i);
+		return (-1);
+	    }
+	    else
+	    {
+		for (j = 0; j < size; j++)
+		{
+		    mem[i + j] = next_tag;
+		}
+		live[n_live] = i;
+		len[n_live] = size;
+		tag[n_live] = next_tag++;
+		n_live++;
+	    }
+	}
+	mem_available(&empty, &large, &n_holes);
+	(void) mem_internal();
+    }
+
+    while (n_live > 0)
+    {
+	mem_free(live[--n_live]);
+    }
+    mem_available(&empty, &large, &n_holes);
+    printf("%-14s %ld stappen, %ld mislukt; leeg: %ld vrij, grootste gat "
+	   "%ld, %ld gaten, interne fragmentatie %6.4f\n", name, n_steps,
+	   n_failed, empty, large, n_holes, mem_internal());
+    return (0);
+}
+
+int main(int argc, char *argv[])
+{
+    long n_steps = 300000, max_request = 2048, size = MEM_SIZE_DEFAULT;
+    unsigned seed = 1;
+    long *mem;
+    int opt, i, result = 0;
+
+    while ((opt = getopt(argc, argv, "s:n:r:m:")) != -1)
+    {
+	switch (opt)
+	{
+	case 's':
+	    seed = (unsigned) strtoul(optarg, NULL, 10);
+	    break;
+	case 'n':
+	    n_steps = strtol(optarg, NULL, 10);
+	    break;
+	case 'r':
+	    max_request = strtol(optarg, NULL, 10);
+	    break;
+	case 'm':
+	    size = strtol(optarg, NULL, 10);
+	    break;
+	default:
+	    fprintf(stderr, "Gebruik: %s [-s seed] [-n stappen] [-r grootste "
+		    "aanvraag] [-m MEM_SIZE] [implementatie...]\n", argv[0]);
+	    return (2);
+	}
+    }
+    if ((max_request < 1) || (mem_configure(size, 0) != 0))
+    {
+	fprintf(stderr, "%s: ongeldige grootte\n", argv[0]);
+	return (2);
+    }
+#ifndef MEM_STATS_CHECK
+    printf("Gebouwd zonder MEM_STATS_CHECK: alleen de inhoud van de "
+	   "toegewezen stukken wordt gecontroleerd\n");
+#endif
+    mem = mem_map();
+
+    if (optind == argc)
+    {
+	for (i = 0; i < N_ALL; i++)
+	{
+	    mem_select(all_backends[i]->name);
+	    result |= run(all_backends[i]->name, mem, n_steps, max_request,
+			  seed);
+	}
+    }
+    for (i = optind; i < argc; i++)
+    {
+	if (mem_select(argv[i]) != 0)
+	{
+	    fprintf(stderr, "%s: onbekende implementatie %s\n", argv[0],
+		    argv[i]);
+	    return (2);
+	}
+	result |= run(argv[i], mem, n_steps, max_request, seed);
+    }
+    return (result ? 1 : 0);
+}
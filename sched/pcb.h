@@ -1,6 +1,8 @@
 #ifndef SCHEDULER_PCB_H
 #define SCHEDULER_PCB_H
 
+// Default number of IO devices; with more, device i behaves like device
+// i % N_IO_DEVICES
 #define N_IO_DEVICES (3)
 
 struct student_pcb;
@@ -10,13 +12,14 @@ typedef enum { INIT_STATE, READY_STATE, IO_STATE, DEFUNCT_STATE } proc_state;
 
 typedef struct sim_pcb {
     double cpu_need, io_need[N_IO_DEVICES];
-    double cpu_used, io_used[N_IO_DEVICES];
-    double cpu_burst, io_burst[N_IO_DEVICES];
+    double cpu_used, io_used;
+    double cpu_burst, io_burst;
     double t_create, t_mem_alloc, t_cpu, t_io, t_end;
     struct sim_pcb *prev, *next, *prev_queue, *next_queue;
     student_pcb *stud_pcb, *in_queue;
     long mem_need, mem_base, proc_num, io_queue, io_cycles;
     proc_state state;
+    struct sim_pcb *prev_io, *next_io; // in the queue of device io_queue
 } sim_pcb;
 
 #endif // SCHEDULER_PCB_H
@@ -64,12 +64,33 @@ typedef struct student_pcb {
     long mem_need, mem_base;
 } student_pcb;
 
+/****************************************************************************
+   Een pcb_queue is een dubbel verbonden lijst van student_pcb's waarvan
+   ook het laatste element en de lengte worden bijgehouden, zodat achteraan
+   toevoegen en de lengte opvragen geen hele rij hoeven door te lopen.
+   head en tail zijn NULL voor een lege rij.
+****************************************************************************/
+
+typedef struct pcb_queue {
+    student_pcb *head, *tail;
+    long length;
+} pcb_queue;
+
 // The functions below are convenient to use for process queue manipulation.
+// Each works both on a pcb_queue and on a plain list, given as a pointer to
+// its first item (student_pcb **), so schedulers can keep lists of their own.
 // Feel free to implement more of your own
 // functions if these functions do not do what you want.
 
+// Called by the pcb_queue functions below whenever an item is added to
+// (delta 1) or removed from (delta -1) a queue; the simulator uses it to keep
+// track of its queues. If you change prev and next of the items in its
+// queues yourself, run the simulator with --check=1 so that it does not
+// depend on these calls.
+void queue_notify(pcb_queue *queue, student_pcb *item, int delta);
+
 // Returns the length of a queue
-static int queue_length(student_pcb **queue) {
+static int list_length(student_pcb **queue) {
     int length = 0;
 
     student_pcb *current = *queue;
@@ -81,9 +102,15 @@ static int queue_length(student_pcb **queue) {
     return length;
 }
 
+static int pcb_queue_length(pcb_queue *queue) { return queue->length; }
+
+#define queue_length(queue)                                                    \
+    _Generic((queue), pcb_queue *: pcb_queue_length, default: list_length)(    \
+        queue)
+
 // Attaches a new item at the front of a queue (item must not be in any queue,
 // i.e. newly created or removed)
-static void queue_prepend(student_pcb **queue, student_pcb *item) {
+static void list_prepend(student_pcb **queue, student_pcb *item) {
     assert(item->prev == NULL);
     assert(item->next == NULL);
 
@@ -95,8 +122,21 @@ static void queue_prepend(student_pcb **queue, student_pcb *item) {
     item->prev = NULL;
 }
 
+static void pcb_queue_prepend(pcb_queue *queue, student_pcb *item) {
+    list_prepend(&queue->head, item);
+    if (!queue->tail) {
+        queue->tail = item;
+    }
+    queue->length++;
+    queue_notify(queue, item, 1);
+}
+
+#define queue_prepend(queue, item)                                             \
+    _Generic((queue), pcb_queue *: pcb_queue_prepend, default: list_prepend)(  \
+        queue, item)
+
 // Retrieves the last item of a queue
-static student_pcb *queue_last(student_pcb **queue) {
+static student_pcb *list_last(student_pcb **queue) {
     student_pcb *current = *queue;
     student_pcb *last = NULL;
 
@@ -108,9 +148,14 @@ static student_pcb *queue_last(student_pcb **queue) {
     return last;
 }
 
+static student_pcb *pcb_queue_last(pcb_queue *queue) { return queue->tail; }
+
+#define queue_last(queue)                                                      \
+    _Generic((queue), pcb_queue *: pcb_queue_last, default: list_last)(queue)
+
 // Removes an item from a queue (THIS FUNCTION DOES NOT CHECK WHETHER THE ITEM
 // IS IN THE QUEUE AND WILL NOT BEHAVE PROPERLY WHEN THE WRONG QUEUE IS PASSED)
-static void queue_remove(student_pcb **queue, student_pcb *item) {
+static void list_remove(student_pcb **queue, student_pcb *item) {
     student_pcb *next = item->next;
 
     // Fix the next pointer of the node before this (or the head of the list if
@@ -131,15 +176,28 @@ static void queue_remove(student_pcb **queue, student_pcb *item) {
     item->prev = NULL;
 }
 
+static void pcb_queue_remove(pcb_queue *queue, student_pcb *item) {
+    if (item == queue->tail) {
+        queue->tail = item->prev;
+    }
+    list_remove(&queue->head, item);
+    queue->length--;
+    queue_notify(queue, item, -1);
+}
+
+#define queue_remove(queue, item)                                              \
+    _Generic((queue), pcb_queue *: pcb_queue_remove, default: list_remove)(    \
+        queue, item)
+
 // Append an item at the back of the queue (item must not be in any queue, i.e.
 // newly created or removed)
-static void queue_append(student_pcb **queue, student_pcb *item) {
+static void list_append(student_pcb **queue, student_pcb *item) {
     assert(item->next == NULL);
     assert(item->prev == NULL);
 
     if (*queue) {
         // Queue is non-empty, find the last node and attach item to it
-        student_pcb *last = queue_last(queue);
+        student_pcb *last = list_last(queue);
         assert(last->next == NULL);
         last->next = item;
         item->prev = last;
@@ -149,6 +207,26 @@ static void queue_append(student_pcb **queue, student_pcb *item) {
     }
 }
 
+static void pcb_queue_append(pcb_queue *queue, student_pcb *item) {
+    assert(item->next == NULL);
+    assert(item->prev == NULL);
+
+    if (queue->tail) {
+        assert(queue->tail->next == NULL);
+        queue->tail->next = item;
+        item->prev = queue->tail;
+    } else {
+        queue->head = item;
+    }
+    queue->tail = item;
+    queue->length++;
+    queue_notify(queue, item, 1);
+}
+
+#define queue_append(queue, item)                                              \
+    _Generic((queue), pcb_queue *: pcb_queue_append, default: list_append)(    \
+        queue, item)
+
 /****************************************************************************
    De wachtrijen.
    Nieuwe processen worden achteraan in de rij new_proc bijgeplaatst.
@@ -164,9 +242,11 @@ static void queue_append(student_pcb **queue, student_pcb *item) {
    Als een proces I/O wil doen (gesimuleerd), komt het in de io_proc rij.
    Laat deze rij met rust.
    Een beeindigd proces komt in de defunct_proc rij. Ruim deze op.
+   Het eerste proces van een rij is b.v. new_proc.head, het aantal
+   processen erin new_proc.length.
  *****************************************************************************/
 
-extern student_pcb *new_proc, *ready_proc, *io_proc, *defunct_proc;
+extern pcb_queue new_proc, ready_proc, io_proc, defunct_proc;
 
 /****************************************************************************
    De door de practicum-leiding aangeleverde fucties
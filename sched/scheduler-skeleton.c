@@ -19,9 +19,9 @@
    April 14, 2020
 */
 
-/* This variable will simulate the allocatable memory */
+/* This variable will simulate the allocatable memory (MEM_SIZE longs) */
 
-static long memory[MEM_SIZE];
+static long *memory;
 
 /* The actual CPU scheduler is implemented here */
 
@@ -30,10 +30,10 @@ static void cpu_scheduler() { /* Insert the code for a MLFbQ scheduler here */ }
 /* The high-level memory allocation scheduler is implemented here */
 
 static void give_memory() {
-    int index;
+    long index;
     student_pcb *proc;
 
-    proc = new_proc;
+    proc = new_proc.head;
     if (proc) {
         /* Search for new process(es) that should be given memory.
            Insert search code and criteria here. Remember you may
@@ -61,7 +61,7 @@ static void give_memory() {
 static void reclaim_memory() {
     student_pcb *proc;
 
-    proc = defunct_proc;
+    proc = defunct_proc.head;
     while (proc) {
         /* Free your own administrative structure if it exists
          */
@@ -79,7 +79,7 @@ static void reclaim_memory() {
 
         /* See if there are more processes to be removed
          */
-        proc = defunct_proc;
+        proc = defunct_proc.head;
     }
 }
 
@@ -93,6 +93,7 @@ void schedule(event_type event) {
     static int first = 1;
 
     if (first) {
+        memory = mem_map();
         mem_init(memory);
         finale = my_finale;
         first = 0;
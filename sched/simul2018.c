@@ -8,8 +8,11 @@
 #include <inttypes.h>
 #include <locale.h>
 #include <limits.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
 #include "schedule.h"
 #include "mem_alloc.h"
 #include "pcb.h"
@@ -37,23 +40,38 @@
         Time-averages only.
 */
 
-student_pcb *new_proc, *ready_proc, *io_proc, *defunct_proc;
+pcb_queue new_proc, ready_proc, io_proc, defunct_proc;
 function *finale;
 function *reset_stats;
 
-#define N_SAMPLES (40960)
-
 #define MAX_ERRORS (150)
 
 #define MEM_MIN (512)
 
 #define N_REQUESTS (4)
 
+// Streaming statistics of a process event time: count, mean and variance
+// (Welford), exact minimum and maximum, and a log-linear histogram. Values in
+// [2^k, 2^(k+1)) are spread over HIST_SUB equal buckets, so a quantile read
+// from the histogram is off by less than 1 / HIST_SUB of its value. Values
+// below 2^HIST_MIN_EXP share bucket 0, values from 2^HIST_MAX_EXP the last.
+#define HIST_SUB_BITS (7)
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MIN_EXP (-10)
+#define HIST_MAX_EXP (53)
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_MIN_EXP) * HIST_SUB + 2)
+
+typedef struct time_stats {
+    long n;
+    double mean, m2, min, max;
+    long count[HIST_BUCKETS];
+} time_stats;
+
 // Statistical data about process event times
-static float t_mem_alloc[N_SAMPLES];
-static float t_first_cpu[N_SAMPLES];
-static float t_execution[N_SAMPLES];
-static float t_turnaround[N_SAMPLES];
+static time_stats t_mem_alloc;
+static time_stats t_first_cpu;
+static time_stats t_execution;
+static time_stats t_turnaround;
 
 // Whether or not to collect some statistics (set to true by main)
 static bool get_stats = false;
@@ -64,25 +82,18 @@ static long num_terminated_processes;
 // Used to terminate program when there are too many errors
 static long n_errors_detected = 0;
 
-// Number of statistical samples collected (used as array index)
+// Number of processes finished since the statistics were started
 static long n_samples = 0;
 
 // Unique process ID counter
 static long proc_num = 0;
 
 // Data about queue lengths
-static long current_defunct_queue_len = 0;
-static long current_io_queue_len[N_IO_DEVICES] = {0, 0, 0};
-static long current_cpu_queue_len = 0;
-static long current_new_queue_len = 0;
-
 static long max_defunct_queue_len = 0;
-static long max_io_queue_len[N_IO_DEVICES] = {0, 0, 0};
 static long max_cpu_queue_len = 0;
 static long max_new_queue_len = 0;
 
 static double avg_defunct_queue_len = 0;
-static double avg_io_queue_len[N_IO_DEVICES] = {0, 0, 0};
 static double avg_cpu_queue_len = 0;
 static double avg_new_queue_len = 0;
 
@@ -94,28 +105,100 @@ static double mem_in_use = 0;
 
 // Utilisation data
 static double mem_util = 0;
-static double io_util[N_IO_DEVICES] = {0, 0, 0};
 static double cpu_util = 0;
 
 static double eps = 1.0e-12;
 
-// The processes which have control of the IO devices and the CPU
-static struct sim_pcb *(current_io_processes[N_IO_DEVICES]) = {NULL, NULL,
-                                                               NULL};
+// The process which has control of the CPU
 static struct sim_pcb *current_cpu_process = NULL;
 
+// An IO device serves the processes in io_proc whose io_queue is its index,
+// in the order in which they appear there. They are linked through prev_io
+// and next_io; the one being served stays at the head until it is ready.
+typedef struct io_device {
+    sim_pcb *head, *tail;
+    long length;
+    sim_pcb *current; // process being served, or NULL
+    bool kicked;      // listed in kicked_devices
+
+    // Accounted up to t_changed, the last time current or length changed
+    double t_changed;
+    long max_queue_len;
+    double avg_queue_len;
+    double util;
+} io_device;
+
+static long n_io_devices = N_IO_DEVICES;
+static io_device *io_devices;
+
+// Adds the time since the device last changed to its statistics, with the
+// state it had all that time. Called at time t before every change of
+// current or length, and before the statistics are read
+static void io_device_account(io_device *dev, double t) {
+    if (get_stats) {
+        if (dev->current) {
+            dev->util += t - dev->t_changed;
+        }
+        dev->avg_queue_len += (t - dev->t_changed) * dev->length;
+        if (dev->max_queue_len < dev->length) {
+            dev->max_queue_len = dev->length;
+        }
+    }
+    dev->t_changed = t;
+}
+
+// Devices that may be idle while processes wait for them; do_io only looks
+// at these
+static long *kicked_devices;
+static long n_kicked = 0;
+
+// The process whose IO burst ended with the last READY_EVENT
+static sim_pcb *io_done = NULL;
+
 // These pointers maintain a secondary list of all processes (aside from the one
 // accessible to students) in order to check whether all processes are still in
 // queues, etc. (See check_all function)
 static struct sim_pcb *last = NULL;
 static struct sim_pcb *first = NULL;
 
+// Processes that have not been given memory yet, linked through prev_queue
+// and next_queue. Only these need to be checked for a new mem_base.
+static struct sim_pcb *mem_waiting = NULL;
+
+// The queue lengths are kept up to date by queue_notify; check_all only
+// walks every queue once per check_interval events (1: after each event)
+static long check_interval = 4096;
+static long n_checks = 0;
+static bool warned_counts = false;
+
 static double t_simulation_now = 0.0, t_step = 0.0;
 static double t_start;
 static double t_slice = 9.9e12;
 
 static event_type cur_event;
 
+/* The future event list: a binary heap of timers, ordered by time.
+   On equal times the timer with the lowest rank goes first, in the order
+   new process, time slice, CPU, IO device 0, 1, 2, ...
+   Each timer knows its place in the heap, so that it can be moved or
+   cancelled in O(log n). */
+typedef struct timer {
+    double t;  // time at which the timer expires
+    long rank; // order on equal times
+    long pos;  // place in the heap, -1 if the timer is not running
+} timer;
+
+// Timer IO_TIMER + i belongs to IO device i
+enum { NEW_TIMER, SLICE_TIMER, CPU_TIMER, IO_TIMER };
+
+static timer *timers;
+static timer **fel;
+static long fel_size = 0;
+
+// Number of events handled and the (wall-clock) time they took
+static long n_events = 0;
+static struct timespec t_wall_start;
+
 /***********************************************************************
    The execution of a process is as follows.
    It starts with a CPU burst, next an IO burst on device 0, CPU, IO on device 1
@@ -184,9 +267,9 @@ at
 static sim_pcb request[N_REQUESTS] = {/* 1 */ {10,
                                                {5, 11, 15},
                                                0,
-                                               {0, 0, 0},
+                                               0,
+                                               3,
                                                3,
-                                               {3, 5, 3},
                                                0,
                                                0,
                                                0,
@@ -203,13 +286,15 @@ static sim_pcb request[N_REQUESTS] = {/* 1 */ {10,
                                                0,
                                                0,
                                                10,
-                                               INIT_STATE},
+                                               INIT_STATE,
+                                               NULL,
+                                               NULL},
                                       /* 2 */ {20,
                                                {35, 41, 55},
                                                0,
-                                               {0, 0, 0},
+                                               0,
+                                               3,
                                                3,
-                                               {3, 5, 3},
                                                0,
                                                0,
                                                0,
@@ -226,13 +311,15 @@ static sim_pcb request[N_REQUESTS] = {/* 1 */ {10,
                                                0,
                                                0,
                                                13,
-                                               INIT_STATE},
+                                               INIT_STATE,
+                                               NULL,
+                                               NULL},
                                       /* 3 */ {70,
                                                {15, 21, 15},
                                                0,
-                                               {0, 0, 0},
+                                               0,
+                                               3,
                                                3,
-                                               {3, 5, 3},
                                                0,
                                                0,
                                                0,
@@ -249,13 +336,15 @@ static sim_pcb request[N_REQUESTS] = {/* 1 */ {10,
                                                0,
                                                0,
                                                2,
-                                               INIT_STATE},
+                                               INIT_STATE,
+                                               NULL,
+                                               NULL},
                                       /* 4 */ {10,
                                                {5, 51, 15},
                                                0,
-                                               {0, 0, 0},
+                                               0,
+                                               3,
                                                3,
-                                               {3, 5, 3},
                                                0,
                                                0,
                                                0,
@@ -272,18 +361,103 @@ static sim_pcb request[N_REQUESTS] = {/* 1 */ {10,
                                                0,
                                                0,
                                                4,
-                                               INIT_STATE}};
+                                               INIT_STATE,
+                                               NULL,
+                                               NULL}};
 
 static double t_next_new,
     load_factor = 1.0,
     t_delay[N_REQUESTS] = {4, 27, 112,
                            17} /* avg = 40; strongly clustered arrivals */;
 
+static bool timer_before(timer *a, timer *b) {
+    return (a->t < b->t) || (a->t == b->t && a->rank < b->rank);
+}
+
+static void fel_place(timer *tm, long pos) {
+    fel[pos] = tm;
+    tm->pos = pos;
+}
+
+static void fel_sift_up(long pos) {
+    timer *tm = fel[pos];
+
+    while (pos > 0 && timer_before(tm, fel[(pos - 1) / 2])) {
+        fel_place(fel[(pos - 1) / 2], pos);
+        pos = (pos - 1) / 2;
+    }
+    fel_place(tm, pos);
+}
+
+static void fel_sift_down(long pos) {
+    timer *tm = fel[pos];
+    long child;
+
+    while ((child = 2 * pos + 1) < fel_size) {
+        if (child + 1 < fel_size && timer_before(fel[child + 1], fel[child]))
+            child++;
+        if (!timer_before(fel[child], tm))
+            break;
+        fel_place(fel[child], pos);
+        pos = child;
+    }
+    fel_place(tm, pos);
+}
+
+static void fel_init() {
+    long i, n_timers = IO_TIMER + n_io_devices;
+
+    timers = calloc(n_timers, sizeof(timer));
+    fel = calloc(n_timers, sizeof(timer *));
+    io_devices = calloc(n_io_devices, sizeof(io_device));
+    kicked_devices = calloc(n_io_devices, sizeof(long));
+    if (!timers || !fel || !io_devices || !kicked_devices) {
+        printf("Geen geheugen voor %ld IO-kanalen\n", n_io_devices);
+        exit(1);
+    }
+    for (i = 0; i < n_timers; i++) {
+        timers[i].rank = i;
+        timers[i].pos = -1;
+    }
+    fel_size = 0;
+}
+
+// Sets the timer to expire at t, or moves it if it was running
+static void timer_set(timer *tm, double t) {
+    double old = tm->t;
+
+    tm->t = t;
+    if (tm->pos < 0) {
+        fel_place(tm, fel_size++);
+        fel_sift_up(tm->pos);
+    } else if (t < old) {
+        fel_sift_up(tm->pos);
+    } else {
+        fel_sift_down(tm->pos);
+    }
+}
+
+static void timer_cancel(timer *tm) {
+    long pos = tm->pos;
+    timer *moved;
+
+    if (pos < 0)
+        return;
+    tm->pos = -1;
+    moved = fel[--fel_size];
+    if (moved == tm)
+        return;
+    fel_place(moved, pos);
+    fel_sift_up(pos);
+    fel_sift_down(moved->pos);
+}
+
 double sim_time() { return (t_simulation_now); }
 
 void set_slice(double slice) {
     slice = (slice < 1.0) ? 1.0 : slice;
     t_slice = t_simulation_now + slice;
+    timer_set(&timers[SLICE_TIMER], t_slice);
 }
 
 
@@ -314,55 +488,130 @@ double genrand_real1(void)
     /* divided by 2^32-1 */
 }
 
-static int mem_range() {
-    return ((int)(5 * (mem_load * MEM_SIZE /
-                       (1.25 * load_factor + 1.75 * io_time_factor) -
-                       MEM_MIN)));
+/* A random number on [0, n); draws 62 bits when n does not fit in 31 */
+static long genrand_below(long n) {
+    if (n <= INT32_MAX) {
+        return (genrand_int31() % n);
+    }
+    return (((genrand_int31() << 31) | genrand_int31()) % n);
+}
+
+static long mem_range() {
+    long range = (long)(5 * (mem_load * MEM_SIZE /
+                             (1.25 * load_factor + 1.75 * io_time_factor) -
+                             MEM_MIN));
+
+    return ((range < 1) ? 1 : range);
 }
 
-static void sluit_af() { printf("Einde programma\n"); }
+// Banner and closing lines: on stdout with the text statistics, on stderr
+// when stdout carries --format output
+static FILE *info_out;
+
+static void sluit_af() { fprintf(info_out, "Einde programma\n"); }
 
 static void my_init_sim() {}
 
 static void my_reset_stats() {}
 
-static void histogram(float *data, char *text) {
+static long hist_bucket(double v) {
+    int e;
+    double f;
+
+    if (v < ldexp(1.0, HIST_MIN_EXP)) {
+        return 0;
+    }
+    f = frexp(v, &e); // v = f * 2^e, 0.5 <= f < 1
+    if (e - 1 >= HIST_MAX_EXP) {
+        return HIST_BUCKETS - 1;
+    }
+    return 1 + (long)(e - 1 - HIST_MIN_EXP) * HIST_SUB +
+           (long)((2 * f - 1) * HIST_SUB);
+}
+
+// The middle of a bucket, kept within the values actually seen
+static double hist_value(const time_stats *s, long b) {
+    long k = (b - 1) / HIST_SUB + HIST_MIN_EXP, sub = (b - 1) % HIST_SUB;
+    double v;
+
+    if (b == 0) {
+        v = 0.0;
+    } else if (b == HIST_BUCKETS - 1) {
+        v = s->max;
+    } else {
+        v = ldexp(1.0 + (sub + 0.5) / HIST_SUB, k);
+    }
+    return (v < s->min) ? s->min : ((v > s->max) ? s->max : v);
+}
+
+// The smallest value that falls in bucket b
+static double hist_lower(long b) {
+    if (b == 0) {
+        return 0.0;
+    }
+    return ldexp(1.0 + (double)((b - 1) % HIST_SUB) / HIST_SUB,
+                 (int)((b - 1) / HIST_SUB) + HIST_MIN_EXP);
+}
+
+static void time_stats_add(time_stats *s, double v) {
+    double delta = v - s->mean;
+
+    s->n++;
+    s->mean += delta / s->n;
+    s->m2 += delta * (v - s->mean);
+    if (s->n == 1 || v < s->min) {
+        s->min = v;
+    }
+    if (s->n == 1 || v > s->max) {
+        s->max = v;
+    }
+    s->count[hist_bucket(v)]++;
+}
+
+// The value below which a fraction q of the samples lies
+static double time_stats_quantile(const time_stats *s, double q) {
+    long b, seen = 0, rank = (long)ceil(q * s->n);
+
+    rank = (rank < 1) ? 1 : rank;
+    for (b = 0; b < HIST_BUCKETS - 1; b++) {
+        seen += s->count[b];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return hist_value(s, b);
+}
+
+static double time_stats_sigma(const time_stats *s) {
+    return (s->n > 1) ? sqrt(s->m2 / (s->n - 1)) : 0.0;
+}
+
+static void histogram(const time_stats *data, char *text) {
     long N, i, histo[66], j;
-    double av = 0, sigma = 0, scaleh, scale, lim;
-    float max, min, hi;
+    double scaleh, scale, lim, min = data->min, max = data->max;
+    float hi;
     char c;
 
-    N = (n_samples < N_SAMPLES) ? n_samples : N_SAMPLES;
+    N = data->n;
 
     printf("\nHistogram en statistieken van %s\n", text);
-    printf("over de laatste %ld beeindigde processen\n", N);
+    printf("over %ld beeindigde processen\n", N);
 
     if (N < 2) {
         printf("Geen gegevens ...\n");
         return;
     }
-    max = min = data[0];
-
-    for (i = 0; i < N; i++) {
-        av += data[i];
-        sigma += data[i] * data[i];
-        min = (data[i] < min) ? data[i] : min;
-        max = (data[i] > max) ? data[i] : max;
-    }
-    av = av / (double)N;
-    sigma = sigma / (double)N;
-    sigma = sigma - av * av;
-    sigma = N * sigma / ((double)N - 1);
-    sigma = (sigma > 0) ? sqrt(sigma) : 0.0;
 
     scaleh = 65.9 / (max - min);
 
-    for (i = 0; i < 65; i++) {
+    for (i = 0; i < 66; i++) {
         histo[i] = 0;
     }
-    for (i = 0; i < N; i++) {
-        j = (data[i] - min) * scaleh;
-        histo[j]++;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        if (data->count[i]) {
+            j = (hist_value(data, i) - min) * scaleh;
+            histo[j] += data->count[i];
+        }
     }
     hi = 0.0;
     for (i = 0; i < 65; i++) {
@@ -395,18 +644,310 @@ static void histogram(float *data, char *text) {
         printf("%6.0f    ", min + 10.0 * i / scaleh);
     }
     printf("\n                                           tijdseenheden\n");
-    printf("\nGemiddelde waarde: %6.1f, spreiding: %6.2f\n", av, sigma);
+    printf("\nGemiddelde waarde: %6.1f, spreiding: %6.2f\n", data->mean,
+           time_stats_sigma(data));
     printf("Minimum waarde: %6.1f, maximum waarde: %6.1f\n", min, max);
+    printf("Percentielen: p50 %6.1f, p90 %6.1f, p99 %6.1f, p99.9 %6.1f\n",
+           time_stats_quantile(data, 0.5), time_stats_quantile(data, 0.9),
+           time_stats_quantile(data, 0.99), time_stats_quantile(data, 0.999));
     printf(
         "-----------------------------------------------------------------\n");
 }
 
+// Machine-readable statistics (--format): JSON with nested objects, or CSV
+// lines "name,value" in which the nested names are joined by dots
+typedef enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV } stat_format;
+
+static stat_format format = FORMAT_TEXT;
+static FILE *stats_out;
+static char stat_prefix[256];
+static int stat_depth = 0;
+static bool stat_first = true;
+
+static void stat_key(const char *name) {
+    if (format == FORMAT_JSON) {
+        fprintf(stats_out, "%s\n%*s\"%s\": ", stat_first ? "" : ",",
+                2 * stat_depth, "", name);
+        stat_first = false;
+    } else {
+        fprintf(stats_out, "%s%s,", stat_prefix, name);
+    }
+}
+
+// Open a nested group; name is NULL for the outermost one
+static void stat_begin(const char *name) {
+    size_t n = strlen(stat_prefix);
+
+    if (format == FORMAT_JSON) {
+        if (name) {
+            stat_key(name);
+        }
+        fputc('{', stats_out);
+        stat_first = true;
+    } else if (name) {
+        snprintf(stat_prefix + n, sizeof(stat_prefix) - n, "%s.", name);
+    } else {
+        fprintf(stats_out, "name,value\n");
+    }
+    stat_depth++;
+}
+
+static void stat_end() {
+    char *dot;
+
+    stat_depth--;
+    if (format == FORMAT_JSON) {
+        fprintf(stats_out, "\n%*s}", 2 * stat_depth, "");
+        stat_first = false;
+    } else if (stat_prefix[0]) {
+        stat_prefix[strlen(stat_prefix) - 1] = '\0';
+        dot = strrchr(stat_prefix, '.');
+        *(dot ? dot + 1 : stat_prefix) = '\0';
+    }
+    if (stat_depth == 0 && format == FORMAT_JSON) {
+        fputc('\n', stats_out);
+    }
+}
+
+static void stat_double(const char *name, double v) {
+    stat_key(name);
+    if (format == FORMAT_JSON && !isfinite(v)) {
+        fprintf(stats_out, "null");
+    } else {
+        fprintf(stats_out, "%.10g", v);
+    }
+    if (format == FORMAT_CSV) {
+        fputc('\n', stats_out);
+    }
+}
+
+static void stat_long(const char *name, long v) {
+    stat_key(name);
+    fprintf(stats_out, (format == FORMAT_CSV) ? "%ld\n" : "%ld", v);
+}
+
+static void stat_string(const char *name, const char *v) {
+    stat_key(name);
+    fprintf(stats_out, (format == FORMAT_CSV) ? "%s\n" : "\"%s\"", v);
+}
+
+static void stat_bool(const char *name, bool v) {
+    stat_key(name);
+    fprintf(stats_out, (format == FORMAT_CSV) ? "%s\n" : "%s",
+            v ? "true" : "false");
+}
+
+static void stat_queue(const char *name, long length, long max, double avg) {
+    stat_begin(name);
+    stat_long("length", length);
+    stat_long("max", max);
+    stat_double("avg", avg);
+    stat_end();
+}
+
+// The bins are the non-empty histogram buckets, named by their lower bound
+static void stat_time_stats(const char *name, const time_stats *data) {
+    long b;
+    char bin[32];
+
+    stat_begin(name);
+    stat_long("n", data->n);
+    stat_double("mean", data->mean);
+    stat_double("sigma", time_stats_sigma(data));
+    stat_double("min", data->min);
+    stat_double("max", data->max);
+    stat_double("p50", time_stats_quantile(data, 0.5));
+    stat_double("p90", time_stats_quantile(data, 0.9));
+    stat_double("p99", time_stats_quantile(data, 0.99));
+    stat_double("p99_9", time_stats_quantile(data, 0.999));
+    stat_begin("bins");
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        if (data->count[b]) {
+            snprintf(bin, sizeof(bin), "%.10g", hist_lower(b));
+            stat_long(bin, data->count[b]);
+        }
+    }
+    stat_end();
+    stat_end();
+}
+
+static double wall_seconds() {
+    struct timespec t_wall;
+
+    clock_gettime(CLOCK_MONOTONIC, &t_wall);
+    return (t_wall.tv_sec - t_wall_start.tv_sec) +
+           (t_wall.tv_nsec - t_wall_start.tv_nsec) / 1e9;
+}
+
+static void print_statistics_formatted() {
+    double t = t_simulation_now - t_start, wall = wall_seconds();
+    long i, counted;
+    char name[32];
+    mem_counts mc;
+
+    counted = num_terminated_processes + new_proc.length + ready_proc.length +
+              io_proc.length + defunct_proc.length;
+    mem_counters(&mc);
+
+    stat_begin(NULL);
+    stat_double("time", t_simulation_now);
+    stat_double("stats_start", t_start);
+    stat_long("processes", proc_num - 100);
+    stat_long("finished", n_samples);
+    stat_bool("consistent", counted == proc_num);
+    stat_begin("memory");
+    stat_long("size", MEM_SIZE);
+    stat_double("avg_used", mem_util / t);
+    stat_double("utilization", mem_util / (t * MEM_SIZE));
+    stat_queue("queue", new_proc.length, max_new_queue_len,
+               avg_new_queue_len / t);
+    stat_end();
+    stat_begin("cpu");
+    stat_double("used", cpu_util);
+    stat_double("utilization", cpu_util / t);
+    stat_queue("queue", ready_proc.length, max_cpu_queue_len,
+               avg_cpu_queue_len / t);
+    stat_end();
+    stat_begin("io");
+    stat_long("length", io_proc.length);
+    stat_begin("devices");
+    for (i = 0; i < n_io_devices; i++) {
+        io_device *dev = &io_devices[i];
+
+        snprintf(name, sizeof(name), "%ld", i);
+        stat_begin(name);
+        stat_long("length", dev->length);
+        stat_long("max", dev->max_queue_len);
+        stat_double("avg", dev->avg_queue_len / t);
+        stat_double("used", dev->util);
+        stat_double("utilization", dev->util / t);
+        stat_end();
+    }
+    stat_end();
+    stat_end();
+    stat_queue("defunct", defunct_proc.length, max_defunct_queue_len,
+               avg_defunct_queue_len / t);
+    stat_begin("events");
+    stat_long("count", n_events);
+    stat_double("wall_seconds", wall);
+    stat_double("per_second", (wall > 0) ? n_events / wall : 0.0);
+    stat_end();
+    stat_begin("allocator");
+    stat_string("backend", mc.backend);
+    stat_long("get_calls", mc.n_get);
+    stat_long("get_failed", mc.n_failed);
+    stat_double("get_ns_avg", mc.get_ns_avg);
+    stat_double("get_ns_max", mc.get_ns_max);
+    stat_long("free_calls", mc.n_free);
+    stat_double("free_ns_avg", mc.free_ns_avg);
+    stat_double("free_ns_max", mc.free_ns_max);
+    stat_long("free_words", mc.empty);
+    stat_long("holes", mc.n_holes);
+    stat_long("largest_usable", mc.large);
+    stat_double("internal_fragmentation", mc.internal);
+    stat_end();
+    stat_begin("histograms");
+    stat_time_stats("mem_wait", &t_mem_alloc);
+    stat_time_stats("first_cpu_wait", &t_first_cpu);
+    stat_time_stats("execution", &t_execution);
+    stat_time_stats("turnaround", &t_turnaround);
+    stat_end();
+    stat_end();
+    fflush(stats_out);
+}
+
+// Time series (--series): every series_interval simulated time units a
+// sample of the queue lengths and the memory, as CSV or, with --format=json,
+// one JSON object per line. Written through a large stdio buffer.
+#define SERIES_BUFFER (1 << 20)
+
+static FILE *series_out;
+static char *series_buffer;
+static double series_interval = 1000.0, t_next_sample = 0.0;
+
+// Run at exit: the buffer must outlive the stream
+static void series_close(void) {
+    fclose(series_out);
+    series_out = NULL;
+    free(series_buffer);
+    series_buffer = NULL;
+}
+
+static void series_open(const char *path) {
+    long i;
+
+    series_out = fopen(path, "w");
+    if (!series_out) {
+        printf("Kan %s niet openen\n", path);
+        exit(1);
+    }
+    // Without a buffer of its own, glibc ignores the size
+    series_buffer = malloc(SERIES_BUFFER);
+    if (series_buffer) {
+        setvbuf(series_out, series_buffer, _IOFBF, SERIES_BUFFER);
+    }
+    atexit(series_close);
+    if (format != FORMAT_JSON) {
+        fprintf(series_out, "t,events,processes,finished,mem_wait,ready,io,"
+                            "defunct,cpu_busy,mem_used,free_words,holes,"
+                            "largest_usable");
+        for (i = 0; i < n_io_devices; i++) {
+            fprintf(series_out, ",io%ld", i);
+        }
+        fputc('\n', series_out);
+    }
+}
+
+static void series_sample(double t) {
+    long i;
+    mem_counts mc;
+
+    mem_counters(&mc);
+    if (format == FORMAT_JSON) {
+        fprintf(series_out,
+                "{\"t\": %.10g, \"events\": %ld, \"processes\": %ld, "
+                "\"finished\": %ld, \"mem_wait\": %ld, \"ready\": %ld, "
+                "\"io\": %ld, \"defunct\": %ld, \"cpu_busy\": %d, "
+                "\"mem_used\": %.0f, \"free_words\": %ld, \"holes\": %ld, "
+                "\"largest_usable\": %ld, \"io_devices\": [",
+                t, n_events, proc_num, num_terminated_processes,
+                new_proc.length, ready_proc.length, io_proc.length,
+                defunct_proc.length, current_cpu_process != NULL, mem_in_use,
+                mc.empty, mc.n_holes, mc.large);
+        for (i = 0; i < n_io_devices; i++) {
+            fprintf(series_out, i ? ", %ld" : "%ld", io_devices[i].length);
+        }
+        fprintf(series_out, "]}\n");
+    } else {
+        fprintf(series_out,
+                "%.10g,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%d,%.0f,%ld,%ld,%ld", t,
+                n_events, proc_num, num_terminated_processes, new_proc.length,
+                ready_proc.length, io_proc.length, defunct_proc.length,
+                current_cpu_process != NULL, mem_in_use, mc.empty, mc.n_holes,
+                mc.large);
+        for (i = 0; i < n_io_devices; i++) {
+            fprintf(series_out, ",%ld", io_devices[i].length);
+        }
+        fputc('\n', series_out);
+    }
+}
+
 void print_statistics() {
     /*
        This routine will print the statistics gathered to this time
      */
 
     long mem_wait = 0, cpu_wait = 0, io_wait = 0, defunct_wait = 0, i;
+    double wall;
+
+    for (i = 0; i < n_io_devices; i++) {
+        io_device_account(&io_devices[i], t_simulation_now);
+    }
+    if (format != FORMAT_TEXT) {
+        print_statistics_formatted();
+        finale();
+        return;
+    }
 
     printf("Statistieken op tijdstip = %6.0f\n", t_simulation_now);
     printf("Opnemen statistieken gestart na 100 aangemaakte processen\n");
@@ -415,10 +956,10 @@ void print_statistics() {
     printf("Aantal gevolgde processen: %ld, aantal gereed: %ld\n",
            proc_num - 100, n_samples);
 
-    mem_wait = queue_length(&new_proc);
-    cpu_wait = queue_length(&ready_proc);
-    io_wait = queue_length(&io_proc);
-    defunct_wait = queue_length(&defunct_proc);
+    mem_wait = new_proc.length;
+    cpu_wait = ready_proc.length;
+    io_wait = io_proc.length;
+    defunct_wait = defunct_proc.length;
 
     printf("Aantal processen wachtend op geheugen: %ld\n", mem_wait);
     printf("Maximum was: %ld, gemiddelde was %f\n", max_new_queue_len,
@@ -432,12 +973,14 @@ void print_statistics() {
     printf("\nGebruikte CPU-tijd: %6.0f, CPU utilisatie: %6.4f\n", cpu_util,
            cpu_util / (t_simulation_now - t_start));
     printf("Aantal in de I/O queue:                %ld\n", io_wait);
-    for (i = 0; i < N_IO_DEVICES; i++) {
+    for (i = 0; i < n_io_devices; i++) {
+        io_device *dev = &io_devices[i];
+
         printf("Maximum voor kanaal %ld was: %ld, gemiddelde %f\n", i,
-               max_io_queue_len[i],
-               avg_io_queue_len[i] / (t_simulation_now - t_start));
+               dev->max_queue_len,
+               dev->avg_queue_len / (t_simulation_now - t_start));
         printf("Gebruikte tijd op IO-kanaal %ld: %6.0f, utilisatie: %6.4f\n", i,
-               io_util[i], io_util[i] / (t_simulation_now - t_start));
+               dev->util, dev->util / (t_simulation_now - t_start));
     }
     printf("Aantal wachtend op opruimen:           %ld\n", defunct_wait);
     printf("Maximum was: %ld, gemiddelde was %f\n", max_defunct_queue_len,
@@ -453,16 +996,21 @@ void print_statistics() {
                    defunct_wait,
                proc_num);
     }
-    histogram(t_mem_alloc, "wachttijd op geheugentoewijzing");
-    histogram(t_first_cpu, "wachttijd op eerste CPU cycle");
-    histogram(t_execution, "executie-tijd vanaf geheugentoewijzing");
-    histogram(t_turnaround, "totale verwerkingstijd");
+    wall = wall_seconds();
+    printf("Aantal events: %ld in %.3f s, %.0f events per seconde\n",
+           n_events, wall, (wall > 0) ? n_events / wall : 0.0);
+    mem_report();
+
+    histogram(&t_mem_alloc, "wachttijd op geheugentoewijzing");
+    histogram(&t_first_cpu, "wachttijd op eerste CPU cycle");
+    histogram(&t_execution, "executie-tijd vanaf geheugentoewijzing");
+    histogram(&t_turnaround, "totale verwerkingstijd");
 
     printf("\nEinde statistieken ----------\n\n");
     finale();
 }
 
-static void new_process(student_pcb **new_proc) {
+static void new_process(pcb_queue *new_proc) {
     /*
        Select the next new process from the list of creatable processes
      */
@@ -470,7 +1018,7 @@ static void new_process(student_pcb **new_proc) {
     student_pcb *new_student_pcb;
     struct sim_pcb *new_sim_pcb;
     double cpu_factor;
-    int i;
+    long i;
 
     static long next_request = 0;
 
@@ -496,9 +1044,9 @@ static void new_process(student_pcb **new_proc) {
     new_sim_pcb->cpu_burst *= (0.8 + 0.4 * genrand_real1());
 
     new_student_pcb->sim_pcb = (void *)new_sim_pcb;
-    i = 1 + (genrand_int31() % mem_range());
+    i = 1 + genrand_below(mem_range());
     new_student_pcb->mem_need = new_sim_pcb->mem_need =
-        MEM_MIN + (genrand_int31() % i);
+        MEM_MIN + genrand_below(i);
     if (new_student_pcb->mem_need > (3 * MEM_SIZE) / 4) {
         new_student_pcb->mem_need = new_sim_pcb->mem_need = (3 * MEM_SIZE) / 4;
     }
@@ -511,6 +1059,13 @@ static void new_process(student_pcb **new_proc) {
     new_student_pcb->prev = NULL;
     new_student_pcb->next = NULL;
 
+    new_sim_pcb->prev_queue = NULL;
+    new_sim_pcb->next_queue = mem_waiting;
+    if (mem_waiting) {
+        mem_waiting->prev_queue = new_sim_pcb;
+    }
+    mem_waiting = new_sim_pcb;
+
     /*
        Tie pcb structures into various queues
      */
@@ -533,66 +1088,226 @@ static void new_process(student_pcb **new_proc) {
 
     next_request = genrand_int31() % N_REQUESTS;
     t_next_new = t_simulation_now + t_delay[next_request] / load_factor;
+    timer_set(&timers[NEW_TIMER], t_next_new);
 }
 
-// Checks whether the queues still make sense
-static void check_all() {
-    sim_pcb *current;
+static void mem_waiting_remove(sim_pcb *my) {
+    if (my->prev_queue) {
+        my->prev_queue->next_queue = my->next_queue;
+    } else if (mem_waiting == my) {
+        mem_waiting = my->next_queue;
+    }
+    if (my->next_queue) {
+        my->next_queue->prev_queue = my->prev_queue;
+    }
+    my->prev_queue = my->next_queue = NULL;
+}
+
+// Notes the processes that have been given memory since the last event
+static void check_memory() {
+    sim_pcb *current, *next;
     student_pcb *stud;
-    long i;
 
-    current = first;
+    current = mem_waiting;
     while (current) {
+        next = current->next_queue;
         stud = current->stud_pcb;
         if (current->mem_base != stud->mem_base) {
-            if (current->mem_base <= 0) {
-                /*
-                   Memory appears to have been allocated...
-                 */
-                current->mem_base = stud->mem_base;
-                current->t_mem_alloc = t_simulation_now;
-                mem_in_use += current->mem_need;
+            /*
+               Memory appears to have been allocated...
+             */
+            current->mem_base = stud->mem_base;
+            current->t_mem_alloc = t_simulation_now;
+            mem_in_use += current->mem_need;
+            if (current->mem_base > 0) {
+                mem_waiting_remove(current);
             }
         }
+        current = next;
+    }
+}
+
+static void io_kick(long i) {
+    if (!io_devices[i].kicked) {
+        io_devices[i].kicked = true;
+        kicked_devices[n_kicked++] = i;
+    }
+}
+
+// Adds a process that entered io_proc to the queue of its device, at the
+// same end
+static void io_device_add(sim_pcb *my, bool front) {
+    io_device *dev = &io_devices[my->io_queue];
+
+    if (front) {
+        my->prev_io = NULL;
+        my->next_io = dev->head;
+        if (dev->head) {
+            dev->head->prev_io = my;
+        } else {
+            dev->tail = my;
+        }
+        dev->head = my;
+    } else {
+        my->next_io = NULL;
+        my->prev_io = dev->tail;
+        if (dev->tail) {
+            dev->tail->next_io = my;
+        } else {
+            dev->head = my;
+        }
+        dev->tail = my;
+    }
+    io_device_account(dev, t_simulation_now);
+    dev->length++;
+    if (!dev->current) {
+        io_kick(my->io_queue);
+    }
+}
+
+static void io_device_remove(sim_pcb *my) {
+    io_device *dev = &io_devices[my->io_queue];
+
+    if (my->prev_io) {
+        my->prev_io->next_io = my->next_io;
+    } else {
+        dev->head = my->next_io;
+    }
+    if (my->next_io) {
+        my->next_io->prev_io = my->prev_io;
+    } else {
+        dev->tail = my->prev_io;
+    }
+    my->prev_io = my->next_io = NULL;
+    io_device_account(dev, t_simulation_now);
+    dev->length--;
+}
+
+void queue_notify(pcb_queue *queue, student_pcb *item, int delta) {
+    sim_pcb *my = (sim_pcb *)item->sim_pcb;
+
+    if (queue == &ready_proc) {
+        if (delta > 0 && my->state == INIT_STATE) {
+            my->state = READY_STATE;
+        }
+    } else if (queue == &io_proc) {
+        if (delta > 0) {
+            io_device_add(my, queue->head == item);
+        } else {
+            io_device_remove(my);
+        }
+    }
+}
+
+/* Counts the items of a queue and makes its tail and length right again, in
+   case the scheduler changed prev and next itself. Returns true if they
+   were right */
+static bool repair_queue(pcb_queue *queue) {
+    student_pcb *stud, *tail = NULL;
+    long length = 0;
+    bool ok;
+
+    for (stud = queue->head; stud; stud = stud->next) {
+        tail = stud;
+        length++;
+    }
+    ok = (queue->tail == tail && queue->length == length);
+    queue->tail = tail;
+    queue->length = length;
+    return ok;
+}
+
+// Checks whether the queues still make sense
+/* Makes the queues of the IO devices follow io_proc again, in case the
+   scheduler changed prev and next itself. Returns true if they did */
+static bool repair_io_devices() {
+    static sim_pcb **expect = NULL;
+    student_pcb *stud;
+    sim_pcb *my;
+    long i;
+    bool ok = true;
+
+    if (!expect) {
+        expect = calloc(n_io_devices, sizeof(sim_pcb *));
+    }
+    for (i = 0; i < n_io_devices; i++) {
+        expect[i] = io_devices[i].head;
+    }
+    for (stud = io_proc.head; stud; stud = stud->next) {
+        my = (sim_pcb *)stud->sim_pcb;
+        if (expect[my->io_queue] != my) {
+            ok = false;
+            break;
+        }
+        expect[my->io_queue] = my->next_io;
+    }
+    for (i = 0; ok && i < n_io_devices; i++) {
+        ok = (expect[i] == NULL);
+    }
+    if (ok) {
+        return true;
+    }
+
+    for (i = 0; i < n_io_devices; i++) {
+        io_device_account(&io_devices[i], t_simulation_now);
+        io_devices[i].head = io_devices[i].tail = NULL;
+        io_devices[i].length = 0;
+    }
+    for (stud = io_proc.head; stud; stud = stud->next) {
+        io_device_add((sim_pcb *)stud->sim_pcb, false);
+    }
+    return false;
+}
+
+static void check_all() {
+    sim_pcb *current;
+    student_pcb *stud;
+    bool ok;
+
+    ok = repair_queue(&new_proc);
+    ok = repair_queue(&ready_proc) && ok;
+    ok = repair_queue(&io_proc) && ok;
+    ok = repair_queue(&defunct_proc) && ok;
+    ok = repair_io_devices() && ok;
+
+    current = first;
+    while (current) {
         current->in_queue = NULL;
         current = current->next;
     }
-    stud = new_proc;
-    current_new_queue_len = queue_length(&new_proc);
-
+    stud = new_proc.head;
     while (stud) {
         current = (sim_pcb *)stud->sim_pcb;
-        current->in_queue = new_proc;
+        current->in_queue = new_proc.head;
         stud = stud->next;
     }
 
-    stud = ready_proc;
-    current_cpu_queue_len = 0;
+    stud = ready_proc.head;
     while (stud) {
-        current_cpu_queue_len++;
         current = (sim_pcb *)stud->sim_pcb;
-        current->in_queue = ready_proc;
+        current->in_queue = ready_proc.head;
         if (current->state == INIT_STATE) {
             current->state = READY_STATE;
         }
         stud = stud->next;
     }
-    stud = io_proc;
-    for (i = 0; i < N_IO_DEVICES; i++) {
-        current_io_queue_len[i] = 0;
-    }
+    stud = io_proc.head;
     while (stud) {
         current = (sim_pcb *)stud->sim_pcb;
-        current->in_queue = io_proc;
-        current_io_queue_len[current->io_queue]++;
+        current->in_queue = io_proc.head;
         stud = stud->next;
     }
-    stud = defunct_proc;
-    current_defunct_queue_len = 0;
+    stud = defunct_proc.head;
     while (stud) {
-        current_defunct_queue_len++;
         current = (sim_pcb *)stud->sim_pcb;
-        current->in_queue = defunct_proc;
+        current->in_queue = defunct_proc.head;
+        stud = stud->next;
+    }
+    if (check_interval > 1 && !warned_counts && !ok) {
+        warned_counts = true;
+        printf("De lengtes van de queues waren niet bijgehouden; worden\n"
+               "prev en next buiten de queue-functies om aangepast?\n"
+               "Gebruik dan --check=1\n");
     }
     current = first;
     while (current) {
@@ -628,45 +1343,56 @@ static void check_all() {
         }
         current = current->next;
     }
-    stud = ready_proc;
-    if (stud) {
-        current = (sim_pcb *)stud->sim_pcb;
-        current_cpu_process = current;
+}
+
+/* Checks the queues after an event. The full check runs once every
+   check_interval events, and whenever the queues no longer hold all
+   processes */
+static void check_queues() {
+    long queued;
+
+    check_memory();
+
+    queued = new_proc.length + ready_proc.length + io_proc.length +
+             defunct_proc.length;
+    if (++n_checks >= check_interval ||
+        queued != proc_num - num_terminated_processes) {
+        n_checks = 0;
+        check_all();
+    }
+
+    if (ready_proc.head) {
+        current_cpu_process = (sim_pcb *)ready_proc.head->sim_pcb;
     } else {
         current_cpu_process = NULL;
     }
 }
 
-static void ready_process(student_pcb **ready_proc, student_pcb **io_proc) {
+static void ready_process(pcb_queue *ready_proc, pcb_queue *io_proc) {
 
     /*
      * How do we indicate that a process is ready? Its state should be ready
      * - even though the process is still in the I/O queue
      */
 
-    /* Now get all ready processes from the IO queues and move them
-       to the end of the ready queue */
+    /* Now get the process that finished its IO from the IO queues and move
+       it to the end of the ready queue */
 
-    student_pcb *current = *io_proc;
-    while (current) {
-        sim_pcb *current_sim = (sim_pcb *)current->sim_pcb;
+    sim_pcb *current_sim = io_done;
+    student_pcb *current = current_sim->stud_pcb;
 
-        if (current_sim->state == READY_STATE) {
-            current_sim->cpu_burst =
-                (current_sim->cpu_need - current_sim->cpu_used) /
-                (1 + current_sim->io_cycles);
-            current_sim->cpu_burst *= (0.6 + 0.8 * genrand_real1());
+    current_sim->cpu_burst = (current_sim->cpu_need - current_sim->cpu_used) /
+                             (1 + current_sim->io_cycles);
+    current_sim->cpu_burst *= (0.6 + 0.8 * genrand_real1());
 
-            queue_remove(io_proc, current);
-            queue_append(ready_proc, current);
+    queue_remove(io_proc, current);
+    current_sim->io_queue = (current_sim->io_queue + 1) % n_io_devices;
+    queue_append(ready_proc, current);
 
-            current_sim->in_queue = *ready_proc;
-        }
-        current = current->next;
-    }
+    current_sim->in_queue = ready_proc->head;
 }
 
-static void io_process(student_pcb **io_proc, student_pcb **ready_proc) {
+static void io_process(pcb_queue *io_proc, pcb_queue *ready_proc) {
 
     /*
      * How do we indicate that a process wants to do I/O? Simple - the only
@@ -680,11 +1406,10 @@ static void io_process(student_pcb **io_proc, student_pcb **ready_proc) {
     queue_remove(ready_proc, current);
     queue_append(io_proc, current);
 
-    current_sim_pcb->in_queue = *io_proc;
+    current_sim_pcb->in_queue = io_proc->head;
 }
 
-static void finish_process(student_pcb **defunct_proc,
-                           student_pcb **ready_proc) {
+static void finish_process(pcb_queue *defunct_proc, pcb_queue *ready_proc) {
 
     /*
      * How do we indicate that a process wants to do quit? Simple - the only
@@ -698,7 +1423,7 @@ static void finish_process(student_pcb **defunct_proc,
     queue_remove(ready_proc, current);
     queue_prepend(defunct_proc, current);
 
-    current_sim->in_queue = *defunct_proc;
+    current_sim->in_queue = defunct_proc->head;
 }
 
 static void post_new() {
@@ -710,10 +1435,16 @@ static void post_new() {
      * etc
      */
 
-    check_all();
+    check_queues();
 }
 
-static void post_time() { check_all(); }
+static void post_time() { check_queues(); }
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
 
 static void do_io() {
 
@@ -721,11 +1452,22 @@ static void do_io() {
      * We should find out if there are any I/O devices free, and if so, if
      * there are processes waiting for that particular device
      */
-    long i;
+    long i, k;
     sim_pcb *my;
-    student_pcb *stud;
+    io_device *dev;
 
-    for (i = 0; i < N_IO_DEVICES; i++) {
+    // Devices are started in order, as each start draws random numbers
+    if (n_kicked > 1) {
+        qsort(kicked_devices, n_kicked, sizeof(long), compare_long);
+    }
+    for (k = 0; k < n_kicked; k++) {
+        i = kicked_devices[k];
+        dev = &io_devices[i];
+        dev->kicked = false;
+        my = dev->head;
+        if (dev->current || !my) {
+            continue;
+        }
         /******************************************************************
            IO_burst[0] 3 always
            IO_burst[1] 1 -- 5 uniform, avg 3.
@@ -734,48 +1476,42 @@ static void do_io() {
            i.e. only device 2 can lead to IO-saturation. multiply by a time
         factor to
            allow scaling w.r.t. CPU load.
+           Further devices repeat this pattern.
         *******************************************************************/
-        if (current_io_processes[i] == NULL) {
-            stud = io_proc;
-            while (stud) {
-                my = (sim_pcb *)stud->sim_pcb;
-                if (my->io_queue == i) {
-                    current_io_processes[i] = my;
-                    my->t_io = t_simulation_now;
-                    if (my->io_cycles < 1)
-                        my->io_cycles = 1;
-                    switch (i) {
-                    case 0:
-                        my->io_burst[i] = 3.0;
-                        break;
-                    case 1:
-                        my->io_burst[i] = 1.0 + 4.0 * genrand_real1();
-                        break;
-                    case 2:
-                        my->io_burst[i] = 4.0 + 12.0 * genrand_real1();
-                        break;
-                    }
-                    my->io_burst[i] *= io_time_factor;
-                    my->io_cycles -= 1;
-                    break; /* while (stud) */
-                }
-                stud = stud->next;
-            }
+        io_device_account(dev, t_simulation_now);
+        dev->current = my;
+        my->t_io = t_simulation_now;
+        if (my->io_cycles < 1)
+            my->io_cycles = 1;
+        switch (i % N_IO_DEVICES) {
+        case 0:
+            my->io_burst = 3.0;
+            break;
+        case 1:
+            my->io_burst = 1.0 + 4.0 * genrand_real1();
+            break;
+        case 2:
+            my->io_burst = 4.0 + 12.0 * genrand_real1();
+            break;
         }
+        my->io_burst *= io_time_factor;
+        my->io_cycles -= 1;
+        timer_set(&timers[IO_TIMER + i], my->io_burst + my->t_io);
     }
+    n_kicked = 0;
 }
 
 static void post_ready() {
-    check_all();
+    check_queues();
     do_io();
 }
 
 static void post_io() {
-    check_all();
+    check_queues();
     do_io();
 }
 
-static void post_finish() { check_all(); }
+static void post_finish() { check_queues(); }
 
 static event_type find_next_event() {
     /* The behaviour of the various processes generating events may differ.
@@ -786,44 +1522,46 @@ static event_type find_next_event() {
        ready-list (if it exists) until the next event. We will see again
        later */
 
-    double t_next, t_event;
+    double t_next;
     sim_pcb *my, *next_proc;
     event_type next_event;
+    timer *tm;
     long i;
 
-    next_event = NEW_PROCESS_EVENT;
-    t_next = t_next_new;
-    next_proc = NULL;
-
-    if (t_slice < t_next) {
-        next_event = TIME_EVENT;
-        t_next = t_slice;
-        next_proc = current_cpu_process;
-    }
+    /* The scheduler may have put another process at the head of the ready
+       queue, so the CPU timer is set again on every event */
     my = current_cpu_process;
     if (my) {
-        t_event = t_simulation_now + my->cpu_burst;
-        if (t_event < t_next) {
-            next_proc = my;
-            t_next = t_event;
-            if (my->cpu_burst + my->cpu_used >= my->cpu_need) {
-                next_event = FINISH_EVENT;
-            } else {
-                next_event = IO_EVENT;
-            }
-        }
+        timer_set(&timers[CPU_TIMER], t_simulation_now + my->cpu_burst);
+    } else {
+        timer_cancel(&timers[CPU_TIMER]);
     }
-    for (i = 0; i < N_IO_DEVICES; i++) {
-        my = current_io_processes[i];
-        if (my) {
-            t_event = my->io_burst[i] + my->t_io;
-            if (t_event < t_next) {
-                t_next = t_event;
-                next_proc = my;
-                next_event = READY_EVENT;
-            }
+
+    tm = fel[0];
+    t_next = tm->t;
+    switch (tm->rank) {
+    case NEW_TIMER:
+        next_event = NEW_PROCESS_EVENT;
+        next_proc = NULL;
+        break;
+    case SLICE_TIMER:
+        next_event = TIME_EVENT;
+        next_proc = current_cpu_process;
+        break;
+    case CPU_TIMER:
+        next_proc = my;
+        if (my->cpu_burst + my->cpu_used >= my->cpu_need) {
+            next_event = FINISH_EVENT;
+        } else {
+            next_event = IO_EVENT;
         }
+        break;
+    default:
+        next_event = READY_EVENT;
+        next_proc = io_devices[tm->rank - IO_TIMER].current;
+        break;
     }
+    n_events++;
 
     /*
      * Now we know which event will be next. Whatever the next event will be,
@@ -832,6 +1570,13 @@ static event_type find_next_event() {
      */
 
     t_step = t_next - t_simulation_now;
+
+    /* The queues do not change between events, so every sample up to the
+       coming event sees the state left by the previous one */
+    while (series_out && t_next_sample <= t_next) {
+        series_sample(t_next_sample);
+        t_next_sample += series_interval;
+    }
     if (current_cpu_process) {
         if (current_cpu_process->cpu_used == 0) {
             current_cpu_process->t_cpu = t_simulation_now;
@@ -852,30 +1597,26 @@ static event_type find_next_event() {
      */
 
     if (get_stats) {
-        for (i = 0; i < N_IO_DEVICES; i++) {
-            if (current_io_processes[i])
-                io_util[i] += t_step;
-            if (max_io_queue_len[i] < current_io_queue_len[i])
-                max_io_queue_len[i] = current_io_queue_len[i];
-            avg_io_queue_len[i] += t_step * current_io_queue_len[i];
-        }
         mem_util += t_step * mem_in_use;
-        avg_new_queue_len += t_step * current_new_queue_len;
-        avg_cpu_queue_len += t_step * current_cpu_queue_len;
-        avg_defunct_queue_len += t_step * current_defunct_queue_len;
-        if (max_new_queue_len < current_new_queue_len)
-            max_new_queue_len = current_new_queue_len;
-        if (max_cpu_queue_len < current_cpu_queue_len)
-            max_cpu_queue_len = current_cpu_queue_len;
-        if (max_defunct_queue_len < current_defunct_queue_len)
-            max_defunct_queue_len = current_defunct_queue_len;
+        avg_new_queue_len += t_step * new_proc.length;
+        avg_cpu_queue_len += t_step * ready_proc.length;
+        avg_defunct_queue_len += t_step * defunct_proc.length;
+        if (max_new_queue_len < new_proc.length)
+            max_new_queue_len = new_proc.length;
+        if (max_cpu_queue_len < ready_proc.length)
+            max_cpu_queue_len = ready_proc.length;
+        if (max_defunct_queue_len < defunct_proc.length)
+            max_defunct_queue_len = defunct_proc.length;
     }
     if (next_event == READY_EVENT) {
         i = next_proc->io_queue;
-        current_io_processes[i] = NULL;
+        io_device_account(&io_devices[i], t_next);
+        io_devices[i].current = NULL;
+        io_kick(i);
+        timer_cancel(&timers[IO_TIMER + i]);
         next_proc->state = READY_STATE;
-        next_proc->io_used[i] += next_proc->io_burst[i];
-        next_proc->io_queue = (i + 1) % N_IO_DEVICES;
+        next_proc->io_used += next_proc->io_burst;
+        io_done = next_proc;
     }
     t_simulation_now = t_simulation_now + t_step;
 
@@ -885,23 +1626,22 @@ static event_type find_next_event() {
 long rm_process(student_pcb **process) {
     sim_pcb *my;
     student_pcb *stud;
-    long pn;
 
     stud = *process;
     my = (sim_pcb *)stud->sim_pcb;
-    pn = n_samples % N_SAMPLES;
     n_samples++;
     num_terminated_processes++;
     mem_in_use -= my->mem_need;
 
     // Collect statistics about this process
-    t_mem_alloc[pn] = my->t_mem_alloc - my->t_create;
-    t_first_cpu[pn] = my->t_cpu - my->t_create;
-    t_execution[pn] = t_simulation_now - my->t_mem_alloc;
-    t_turnaround[pn] = t_simulation_now - my->t_create;
+    time_stats_add(&t_mem_alloc, my->t_mem_alloc - my->t_create);
+    time_stats_add(&t_first_cpu, my->t_cpu - my->t_create);
+    time_stats_add(&t_execution, t_simulation_now - my->t_mem_alloc);
+    time_stats_add(&t_turnaround, t_simulation_now - my->t_create);
 
     queue_remove(&defunct_proc, stud);
     free(stud);
+    mem_waiting_remove(my);
 
     // TODO: Maybe make a function for this
     if (my->prev) {
@@ -926,10 +1666,19 @@ struct arguments {
     float mem;
     long proc;
     long seed;
+    long check;
+    long devices;
+    long memsize;
+    int hugepages;
+    char *output;
+    char *series;
+    double interval;
 };
 
 static int parse_opt(int key, char *arg, struct argp_state *state) {
     struct arguments *arguments = state->input;
+    char *end;
+
     switch (key) {
     case 'c':
         arguments->cpu = strtof(arg, NULL);
@@ -946,6 +1695,89 @@ static int parse_opt(int key, char *arg, struct argp_state *state) {
     case 's':
         arguments->seed = strtol(arg, NULL, 10);
         break;
+    case 'd':
+        arguments->devices = strtol(arg, NULL, 10);
+        if (arguments->devices < 1) {
+            argp_error(state, "--devices moet minstens 1 zijn\n");
+        }
+        break;
+    case 'a':
+        if (mem_select(arg) != 0) {
+            printf("Beschikbaar geheugenbeheer:\n");
+            mem_list_backends();
+            fflush(stdout);
+            argp_error(state, "Onbekend geheugenbeheer: %s\n", arg);
+        }
+        break;
+    case 'M': {
+        int shift = 0;
+
+        errno = 0;
+        arguments->memsize = strtol(arg, &end, 10);
+        if (end == arg) {
+            argp_error(state, "Ongeldige --memsize: %s\n", arg);
+        }
+        switch (*end) {
+        case 'k': case 'K':
+            shift = 10;
+            end++;
+            break;
+        case 'm': case 'M':
+            shift = 20;
+            end++;
+            break;
+        case 'g': case 'G':
+            shift = 30;
+            end++;
+            break;
+        }
+        if (*end != '\0') {
+            argp_error(state, "Ongeldige --memsize: %s\n", arg);
+        }
+        if (errno == ERANGE || arguments->memsize > (LONG_MAX >> shift)) {
+            argp_error(state, "--memsize %s is te groot\n", arg);
+        }
+        if (arguments->memsize > 0) {
+            arguments->memsize <<= shift;
+        }
+        if (arguments->memsize < MEM_SIZE_MIN) {
+            argp_error(state, "--memsize moet minstens %d zijn\n",
+                       MEM_SIZE_MIN);
+        }
+        break;
+    }
+    case 'H':
+        arguments->hugepages = 1;
+        break;
+    case 'f':
+        if (strcmp(arg, "text") == 0) {
+            format = FORMAT_TEXT;
+        } else if (strcmp(arg, "json") == 0) {
+            format = FORMAT_JSON;
+        } else if (strcmp(arg, "csv") == 0) {
+            format = FORMAT_CSV;
+        } else {
+            argp_error(state, "--format moet text, json of csv zijn\n");
+        }
+        break;
+    case 'o':
+        arguments->output = arg;
+        break;
+    case 'S':
+        arguments->series = arg;
+        break;
+    case 't':
+        arguments->interval = strtod(arg, NULL);
+        if (!(arguments->interval > 0)) {
+            argp_error(state, "--interval moet groter dan 0 zijn\n");
+        }
+        break;
+    case 'k':
+        arguments->check = strtol(arg, NULL, 10);
+        if (arguments->check < 1) {
+            argp_error(state, "--check moet minstens 1 zijn\n");
+        }
+        break;
     case ARGP_KEY_FINI:
         if (!(((0 < arguments->cpu) && (1.0 > arguments->cpu)) &&
               ((0 < arguments->io) && (1.0 > arguments->io)) &&
@@ -998,6 +1830,7 @@ int main(int argc, char *argv[]) {
 
     long N_to_create = 7;
     long ranseed = 1579;
+    long i;
 
     struct argp_option options[] = {
         {0, 0, 0, 0, "Verplicht:", 1},
@@ -1007,6 +1840,32 @@ int main(int argc, char *argv[]) {
         {"proc", 'p', "INT", 0, "aantal aan te maken processen", 0},
         {0, 0, 0, 0, "Optioneel:", -1},
         {"seed", 's', "INT", 0, "Seed voor de random generator", -1},
+        {"devices", 'd', "INT", 0, "Aantal IO-kanalen (standaard 3)", -1},
+        {"alloc", 'a', "NAAM", 0,
+         "Geheugenbeheer: choose (standaard), segfit, segfit-choose, "
+         "bestfit, buddy of tlsf",
+         -1},
+        {"memsize", 'M', "INT[KMG]", 0,
+         "Grootte van het geheugen in longs (standaard 32768), K, M of G "
+         "vermenigvuldigt met 2^10, 2^20 of 2^30",
+         -1},
+        {"hugepages", 'H', 0, 0, "Vraag huge pages voor het geheugen", -1},
+        {"format", 'f', "FORMAAT", 0,
+         "Statistieken als text (standaard), json of csv", -1},
+        {"output", 'o', "BESTAND", 0,
+         "Schrijf de json- of csv-statistieken naar BESTAND in plaats van "
+         "naar stdout",
+         -1},
+        {"series", 'S', "BESTAND", 0,
+         "Schrijf elke --interval tijdseenheden de lengtes van de queues en "
+         "het vrije geheugen naar BESTAND (csv, of json per regel)",
+         -1},
+        {"interval", 't', "FLOAT", 0,
+         "Tijd tussen twee metingen voor --series (standaard 1000)", -1},
+        {"check", 'k', "INT", 0,
+         "Controleer de queues volledig om de INT events (standaard 4096, "
+         "1: na elk event)",
+         -1},
         {0, 0, 0, 0, 0, 0}};
     struct argp argp = {options, parse_opt, 0, 0, 0, 0, 0};
 
@@ -1015,12 +1874,21 @@ int main(int argc, char *argv[]) {
     arguments.io = 0;
     arguments.mem = 0;
     arguments.proc = 0;
-    printf("Simulatie van geheugen-toewijzing en proces-scheduling\n");
-    printf("Versie 2015-2016\n");
+    arguments.seed = 0;
+    arguments.check = check_interval;
+    arguments.devices = n_io_devices;
+    arguments.memsize = MEM_SIZE_DEFAULT;
+    arguments.hugepages = 0;
+    arguments.output = NULL;
+    arguments.series = NULL;
+    arguments.interval = series_interval;
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
-    printf("CPU: %f\n", arguments.cpu);
-    printf("io: %f\n", arguments.io);
-    printf("mem: %f\n", arguments.mem);
+    info_out = (format == FORMAT_TEXT) ? stdout : stderr;
+    fprintf(info_out, "Simulatie van geheugen-toewijzing en proces-scheduling\n");
+    fprintf(info_out, "Versie 2015-2016\n");
+    fprintf(info_out, "CPU: %f\n", arguments.cpu);
+    fprintf(info_out, "io: %f\n", arguments.io);
+    fprintf(info_out, "mem: %f\n", arguments.mem);
 
     load_factor = arguments.cpu;
 
@@ -1029,12 +1897,27 @@ int main(int argc, char *argv[]) {
 
     mem_load = arguments.mem;
 
+    check_interval = arguments.check;
+    n_io_devices = arguments.devices;
+    if (mem_configure(arguments.memsize, arguments.hugepages) != 0) {
+        printf("Ongeldige geheugengrootte %ld\n", arguments.memsize);
+        exit(1);
+    }
+
+    stats_out = stdout;
+    if (arguments.output) {
+        stats_out = fopen(arguments.output, "w");
+        if (!stats_out) {
+            printf("Kan %s niet openen\n", arguments.output);
+            exit(1);
+        }
+    }
+    series_interval = arguments.interval;
+
     N_to_create = arguments.proc;
-    printf("Gelezen waarde: %ld\n", N_to_create);
-    N_to_create = (N_to_create < 5)
-                      ? 5
-                      : ((N_to_create > N_SAMPLES) ? N_SAMPLES : N_to_create);
-    printf("Gebruikte waarde: %ld\n", N_to_create);
+    fprintf(info_out, "Gelezen waarde: %ld\n", N_to_create);
+    N_to_create = (N_to_create < 5) ? 5 : N_to_create;
+    fprintf(info_out, "Gebruikte waarde: %ld\n", N_to_create);
     if(arguments.seed == 0){
         PRNG_state = ranseed;
     }else{
@@ -1042,12 +1925,19 @@ int main(int argc, char *argv[]) {
     }
     my_init_sim();
 
-    new_proc = io_proc = ready_proc = defunct_proc = NULL;
+    new_proc = io_proc = ready_proc = defunct_proc = (pcb_queue){NULL, NULL, 0};
     t_start = 0;
 
     finale = sluit_af;
     reset_stats = my_reset_stats;
 
+    fel_init();
+    if (arguments.series) {
+        series_open(arguments.series);
+    }
+    timer_set(&timers[SLICE_TIMER], t_slice);
+    clock_gettime(CLOCK_MONOTONIC, &t_wall_start);
+
     cur_event = NEW_PROCESS_EVENT;
 
     while (proc_num < 100) {
@@ -1140,9 +2030,13 @@ int main(int argc, char *argv[]) {
         }
     }
     n_samples = 0;
+    t_mem_alloc = t_first_cpu = t_execution = t_turnaround = (time_stats){0};
     t_start = t_simulation_now;
     reset_stats();
     get_stats = true;
+    for (i = 0; i < n_io_devices; i++) {
+        io_devices[i].t_changed = t_start;
+    }
     while (proc_num < N_to_create + 100) {
         switch (cur_event) {
         case NEW_PROCESS_EVENT: